@@ -22,6 +22,17 @@ namespace slicer {
 		bool result;
 	};
 
+	struct AliasQuery {
+		AliasQuery(const ConstInstList &a, const Value *b,
+				const ConstInstList &c, const Value *d):
+			c1(a), v1(b), c2(c), v2(d) {}
+
+		ConstInstList c1;
+		const Value *v1;
+		ConstInstList c2;
+		const Value *v2;
+	};
+
 	struct AdvancedAlias: public ModulePass, public AliasAnalysis {
 		static char ID;
 
@@ -54,6 +65,14 @@ namespace slicer {
 		AliasResult alias(
 				const ConstInstList &c1, const Value *v1,
 				const ConstInstList &c2, const Value *v2);
+		/**
+		 * Answers a batch of context-sensitive queries at once. 
+		 * Equivalent to calling alias(c1, v1, c2, v2) on each query, but
+		 * lets SolveConstraints share the work among the queries and
+		 * run them in parallel. 
+		 */
+		void alias(const vector<AliasQuery> &queries,
+				vector<AliasResult> &results);
 		/**
 		 * May aliasing seems pretty slow, but must aliasing is fast. 
 		 * Therefore, we provide this interface to perform fast must-aliasing
@@ -68,6 +87,15 @@ namespace slicer {
 		bool may_alias(const Use *u1, const Use *u2);
 
 		void get_must_alias_pairs(vector<ConstValuePair> &must_alias_pairs) const;
+		/**
+		 * # of may-alias or not-must-alias answers given so far. Only these
+		 * answers may change after <recalculate>; not-may and must answers
+		 * are retained. Clients compare it before and after a computation to
+		 * tell whether the computation can be reused. 
+		 */
+		size_t get_num_tentative_answers() const {
+			return num_tentative_answers;
+		}
 
 	private:
 		void print_average_query_time(raw_ostream &O) const;
@@ -83,6 +111,7 @@ namespace slicer {
 		DenseMap<ConstValuePair, bool> may_cache; // Cache satisfiable() results. 
 		DenseMap<ConstValuePair, bool> must_cache; // Cache provable() results.
 		vector<pair<clock_t, QueryInfo> > query_times;
+		size_t num_tentative_answers;
 	};
 }
 
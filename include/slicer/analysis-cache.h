@@ -0,0 +1,53 @@
+/**
+ * Author: Jingyue
+ *
+ * Persists the results of expensive, trace-independent analyses across
+ * runs of the slicer on the same bitcode.
+ *
+ * The cache is a directory given by -analysis-cache-dir. Each entry is a
+ * file named after the pass, the hash of the printed module and the hash
+ * of the options the result depends on. Therefore, a modified module or a
+ * different option never hits a stale entry, and entries need no
+ * invalidation. An entry is a list of unsigneds; it's the pass's job to
+ * encode its result with IDs that are stable for the same bitcode, e.g.
+ * the ones from IDAssigner.
+ */
+
+#ifndef __SLICER_ANALYSIS_CACHE_H
+#define __SLICER_ANALYSIS_CACHE_H
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "llvm/Module.h"
+using namespace llvm;
+
+namespace slicer {
+	struct AnalysisCache {
+		// Returns true if -analysis-cache-dir is specified.
+		static bool enabled();
+		static long hash_string(const string &str);
+		// Hashes the printed <M>.
+		static long hash_module(const Module &M);
+		/**
+		 * Returns the file that caches the result of <pass_name> on the
+		 * module whose <hash_module> is <module_hash>, computed with
+		 * <options>.
+		 * Requires the cache to be enabled.
+		 */
+		static string get_file_name(long module_hash, const string &pass_name,
+				const string &options);
+		/**
+		 * Returns false if <file_name> does not exist or is truncated.
+		 */
+		static bool load(const string &file_name, vector<unsigned> &data);
+		/**
+		 * Writes to a temporary file and renames it to <file_name>, so that
+		 * concurrent runs never see a partial entry.
+		 */
+		static bool save(const string &file_name, const vector<unsigned> &data);
+	};
+}
+
+#endif
@@ -29,8 +29,32 @@ using namespace std;
 #include "slicer/region-manager.h"
 
 namespace slicer {
+	struct OverwriterTask;
+
+	/**
+	 * Constraints captured on a load or a global variable, kept across
+	 * <recalculate>s. The result depends on alias results, so it's reused
+	 * only when the current level is in [valid_from, valid_until) and
+	 * the advanced AA is used or not used in the same way. 
+	 */
+	struct CaptureResult {
+		CaptureResult(): captured(false), used_advanced_alias(false),
+			valid_from(0), valid_until(0) {}
+
+		bool captured;
+		vector<Clause *> constraints;
+		// The printed <constraints>. 
+		vector<string> keys;
+		// Global variables only. Loads that always read the same value. 
+		InstList equivalent_loads;
+		bool used_advanced_alias;
+		unsigned valid_from, valid_until;
+	};
+
 	struct CaptureConstraints: public ModulePass {
 		const static unsigned INVALID_VAR_ID = (unsigned)-1;
+		// A path between the landmark (thr_id, trunk_id) and an instruction. 
+		typedef pair<pair<int, size_t>, const Instruction *> LandmarkPath;
 
 		static char ID;
 		CaptureConstraints();
@@ -47,8 +71,15 @@ namespace slicer {
 		/**
 		 * Compute a finger print of all the constraints captured. 
 		 * Used to check whether the iterative process should stop. 
+		 * Computed from the sorted constraints in <simplify_constraints>. 
 		 */
 		long get_fingerprint() const;
+		/**
+		 * Hashes the printed <M>. Printing a large module is slow, so the
+		 * hash is computed only once and shared by the analysis cache and
+		 * the query cache of SolveConstraints. 
+		 */
+		long get_module_hash(const Module &M);
 		bool is_reachable_integer(const Value *v) const;
 		/**
 		 * Is <v> an integer that's defined only once?
@@ -104,6 +135,8 @@ namespace slicer {
 		bool comes_from_shallow(const BasicBlock *x, const BasicBlock *y);
 
 	private:
+		friend struct OverwriterTask;
+
 		// Utility functions. 
 		static void print_value(raw_ostream &O, const Value *v);
 		static Value *get_pointer_operand(const Instruction *i);
@@ -138,11 +171,22 @@ namespace slicer {
 		void capture_addr_taken(Module &M);
 		void capture_must_assign(Module &M);
 		void capture_global_vars(Module &M);
-		void capture_global_var(GlobalVariable *gv);
+		void capture_global_var(GlobalVariable *gv, InstList &equivalent_loads);
 		/**
 		 * Returns true if any constraint is captured on this LoadInst. 
 		 */
 		bool capture_overwriting_to(LoadInst *i2);
+		/**
+		 * Finds the stores whose values <i2> must read from one of.
+		 * Read-only, so that it can run in workers. 
+		 */
+		void find_valid_overwriters(LoadInst *i2, InstList &overwriters);
+		/**
+		 * Adds the constraint that <i2> equals the value of one of the
+		 * <overwriters>. Returns false if <overwriters> is empty. 
+		 */
+		bool add_overwriting_constraints(LoadInst *i2,
+				const InstList &overwriters);
 		Instruction *find_latest_overwriter(Instruction *i2, Value *q);
 		BasicBlock *get_idom(BasicBlock *bb);
 		Instruction *get_idom(Instruction *ins);
@@ -167,10 +211,22 @@ namespace slicer {
 		 */
 		bool path_may_write(const Instruction *i1,
 				int thr_id, size_t trunk_id, const Value *q);
-		bool mbbs_may_write(const DenseSet<const ICFGNode *> &blocks,
-				const InstList &starts, const InstList &ends, const Value *q);
-		bool mbb_may_write(const MicroBasicBlock *mbb,
-				const InstList &starts, const InstList &ends, const Value *q);
+		/**
+		 * Find the instructions on the path and summarize what they may
+		 * write with MayWriteAnalyzer. Return the ID of the summary.
+		 * <path_may_write> caches the summaries, so each path is only
+		 * flood-filled once. 
+		 */
+		unsigned summarize_path(const Instruction *i1, const Instruction *i2);
+		unsigned summarize_path(int thr_id, size_t trunk_id,
+				const Instruction *i2);
+		unsigned summarize_path(const Instruction *i1,
+				int thr_id, size_t trunk_id);
+		unsigned summarize_mbbs(const DenseSet<const ICFGNode *> &blocks,
+				const InstList &starts, const InstList &ends);
+		void get_insts_in_mbb(const MicroBasicBlock *mbb,
+				const ConstInstSet &starts, const ConstInstSet &ends,
+				ConstInstList &insts);
 		bool region_may_write(const Region &r, const Value *q);
 		
 		// General functions. 
@@ -180,8 +236,32 @@ namespace slicer {
 		void check_loop(Loop *l, DominatorTree &DT);
 		void check_loops(Module &M);
 		void add_constraint(Clause *c);
+		// <key> is the printed <c>. 
+		void add_constraint(Clause *c, const string &key);
 		void add_constraints(const vector<Clause *> &cs);
 		void clear_constraints();
+		/**
+		 * Incremental recapturing. 
+		 * Constraints on top-level variables, unreachable blocks and
+		 * function summaries do not depend on alias results, so they are
+		 * captured only once. Constraints on loads and global variables are
+		 * recaptured only when their <CaptureResult>s become invalid. 
+		 */
+		void capture_static(Module &M);
+		/**
+		 * Adds the static constraints persisted by <save_static_constraints>.
+		 * Returns false and adds nothing if <file_name> is not in the analysis
+		 * cache or is malformed. 
+		 */
+		bool load_static_constraints(Module &M, const string &file_name);
+		// Persists the constraints added since <start>. 
+		void save_static_constraints(size_t start, const string &file_name);
+		void start_capture_result();
+		// Fills <r> with the constraints added since <start_capture_result>. 
+		void finish_capture_result(CaptureResult &r);
+		bool is_valid(const CaptureResult &r);
+		void add_capture_result(const CaptureResult &r);
+		static void clear_capture_result(CaptureResult &r);
 
 		// Integer and pointer values. 
 		void capture_top_level(Module &M);
@@ -220,7 +300,28 @@ namespace slicer {
 
 		// Data members. 
 		vector<Clause *> constraints;
-		DenseMap<LoadInst *, vector<Clause *> > captured_loads;
+		// The printed <constraints>. 
+		vector<string> constraint_keys;
+		long fingerprint;
+		vector<Clause *> static_constraints;
+		vector<string> static_keys;
+		bool static_captured;
+		long module_hash;
+		bool module_hashed;
+		DenseMap<LoadInst *, CaptureResult> captured_loads;
+		DenseMap<GlobalVariable *, CaptureResult> captured_global_vars;
+		// The mod summary of each region. See MayWriteAnalyzer. 
+		DenseMap<Region, unsigned> region_summaries;
+		// The mod summary of each path in <path_may_write>. 
+		DenseMap<pair<const Instruction *, const Instruction *>, unsigned> paths;
+		map<LandmarkPath, unsigned> paths_from_landmarks, paths_to_landmarks;
+		/**
+		 * What the capture in progress depends on. 
+		 * See <start_capture_result>. 
+		 */
+		size_t capture_start;
+		size_t capture_start_tentative_answers;
+		unsigned capture_valid_from, capture_valid_until;
 		ValueSet fixed_integers;
 		Type *int_type;
 		DominatorTreeBase<ICFGNode> IDT;
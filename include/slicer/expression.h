@@ -6,10 +6,12 @@
 #define __SLICER_EXPRESSION_H
 
 #include <cstdio>
+#include <vector>
 using namespace std;
 
 #include "llvm/Instruction.h"
 #include "llvm/Use.h"
+#include "llvm/LLVMContext.h"
 using namespace llvm;
 
 #include "rcs/IDAssigner.h"
@@ -18,8 +20,15 @@ using namespace rcs;
 
 namespace slicer {
 	/**
-	 * We don't allow any Expr, BoolExpr or Clause has more than one references. 
-	 * TODO: We could allow that by adding reference counting. 
+	 * Subtrees of Expr, BoolExpr and Clause are reference-counted and shared
+	 * among clones. <clone> copies only the top node, so it's O(1). 
+	 * The top node is still owned by whoever created or cloned it, and
+	 * should be deleted as before. 
+	 *
+	 * Because of the sharing, a child must be <unshare>d before being
+	 * modified in place. 
+	 *
+	 * All nodes are allocated from recycling pools. 
 	 */
 	struct Expr {
 		enum Type {
@@ -33,8 +42,14 @@ namespace slicer {
 			const Use *u;
 		};
 		ConstInstList callstack;
+		// # of parents and owners. 
+		mutable unsigned n_refs;
 
 		Expr *clone() const;
+		// Drops a reference, and deletes this node if it's the last one. 
+		void release() const;
+		// Returns a node that has the same content and only one reference. 
+		Expr *unshare();
 		unsigned get_width() const;
 		Expr(const Use *use, unsigned c = 0);
 		// <t> can be LoopBound as well, although seldom used. 
@@ -43,16 +58,23 @@ namespace slicer {
 		Expr(unsigned opcode, Expr *expr);
 		Expr(unsigned opcode, Expr *expr1, Expr *expr2);
 		~Expr();
+		static void *operator new(size_t size);
+		static void operator delete(void *p);
 	};
 
 	// Expressions connected with predicates. 
 	struct BoolExpr {
 		CmpInst::Predicate p;
 		Expr *e1, *e2;
+		mutable unsigned n_refs;
 
 		BoolExpr *clone() const;
+		void release() const;
+		BoolExpr *unshare();
 		BoolExpr(CmpInst::Predicate pred, Expr *expr1, Expr *expr2);
 		~BoolExpr();
+		static void *operator new(size_t size);
+		static void operator delete(void *p);
 	};
 
 	// A clause is a set of boolean expressions connected with AND, OR, or XOR
@@ -60,19 +82,47 @@ namespace slicer {
 		unsigned op;
 		BoolExpr *be;
 		Clause *c1, *c2;
+		mutable unsigned n_refs;
 
 		Clause *clone() const;
+		void release() const;
+		Clause *unshare();
 		Clause(unsigned opcode, Clause *lhs, Clause *rhs);
 		Clause(unsigned opcode, Clause *child);
 		Clause(BoolExpr *expr);
 		~Clause();
+		static void *operator new(size_t size);
+		static void operator delete(void *p);
 	};
 
+	/**
+	 * Makes <x> exclusively owned by its parent, so that it can be modified
+	 * in place. The parent itself must be exclusively owned. 
+	 */
+	template <typename T>
+	void unshare(T *&x) {
+		x = x->unshare();
+	}
+
 	void print_opcode(raw_ostream &O, unsigned op);
 	void print_predicate(raw_ostream &O, CmpInst::Predicate p);
 	void print_expr(raw_ostream &O, const Expr *e, IDAssigner &IDA);
 	void print_bool_expr(raw_ostream &O, const BoolExpr *be, IDAssigner &IDA);
 	void print_clause(raw_ostream &O, const Clause *c, IDAssigner &IDA);
+	/**
+	 * Appends <c> to <data> as a list of unsigneds that can be persisted
+	 * across runs on the same bitcode. Values, uses and callstacks are
+	 * encoded with their IDs. Returns false and leaves <data> unchanged if
+	 * <c> refers to any value without an ID, other than ConstantInts.
+	 */
+	bool encode_clause(const Clause *c, IDAssigner &IDA, vector<unsigned> &data);
+	/**
+	 * Decodes the clause starting at data[pos], and advances <pos> to the
+	 * end of it. Returns NULL if <data> is malformed or refers to values
+	 * that don't exist in the module. <pos> is undefined then.
+	 */
+	Clause *decode_clause(const vector<unsigned> &data, size_t &pos,
+			IDAssigner &IDA, LLVMContext &C);
 
 	/*
 	 * Sort the clauses according to the alphabetic order
@@ -80,6 +130,8 @@ namespace slicer {
 	struct CompareClause {
 		CompareClause(IDAssigner &ida): IDA(ida) {}
 		bool operator()(const Clause *a, const Clause *b);
+		// Compares two printed clauses. 
+		static bool compare_printed(const string &str_a, const string &str_b);
 	private:
 		IDAssigner &IDA;
 	};
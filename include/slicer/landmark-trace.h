@@ -10,6 +10,7 @@
 #define __SLICER_LANDMARK_TRACE_H
 
 #include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
 #include "rcs/util.h"
 using namespace llvm;
 
@@ -34,7 +35,7 @@ namespace slicer {
 		const LandmarkTraceRecord &get_landmark(int thr_id, size_t trunk_id) const;
 		bool is_enforcing_landmark(int thr_id, size_t trunk_id) const;
 		size_t get_n_trunks(int thr_id) const;
-		vector<int> get_thr_ids() const;
+		const vector<int> &get_thr_ids() const;
 		const vector<LandmarkTraceRecord> &get_thr_trunks(int thr_id) const;
 
 		/* Some computation involved */
@@ -73,10 +74,33 @@ namespace slicer {
 		size_t get_latest_happens_before(int tid, size_t trunk_id, int tid2) const;
 		/**
 		 * Find the first landmark in Thread <thr_id> whose landmark >= <idx>
+		 * Takes constant time if the landmarks are evenly spread, and
+		 * logarithmic time in the worst case. 
 		 */
 		size_t search_landmark_in_thread(int thr_id, unsigned idx) const;
 
 	private:
+		/**
+		 * The landmarks of a thread and the indexes built on them. 
+		 */
+		struct ThreadLandmarks {
+			vector<LandmarkTraceRecord> trunks;
+			vector<unsigned> timestamps;
+			// <trunk_id> extended by <extend_until_enforce>. 
+			vector<size_t> region_starts, region_ends;
+			/*
+			 * Timestamps are split into buckets of 2^<bucket_shift>. The
+			 * landmarks in Bucket <b> are [bucket_starts[b], bucket_starts[b + 1]).
+			 * There are at most as many buckets as landmarks, so the index
+			 * grows with the landmarks instead of the full trace. 
+			 */
+			unsigned bucket_shift;
+			vector<unsigned> bucket_starts;
+		};
+
+		void index_thread(ThreadLandmarks &t);
+		const ThreadLandmarks &get_thread(int thr_id) const;
+
 		/**
 		 * Recall that there are two types of landmarks:
 		 * enforcing landmarks and derived landmarks. 
@@ -92,7 +116,11 @@ namespace slicer {
 		 * After it returns, <s> and <e> will indicate the extended region. 
 		 */
 		void extend_until_enforce(int thr_id, size_t &s, size_t &e) const;
-		map<int, vector<LandmarkTraceRecord> > thread_trunks;
+		// Sorted. 
+		vector<int> thr_ids;
+		// Thread ID => index in <threads>. 
+		DenseMap<int, unsigned> thr_indices;
+		vector<ThreadLandmarks> threads;
 	};
 
 }
@@ -14,6 +14,7 @@
 
 #include "llvm/Pass.h"
 #include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "rcs/typedefs.h"
 using namespace llvm;
 
@@ -26,6 +27,8 @@ namespace slicer {
 	static const string SLICER_SUFFIX = ".SLICER";
 	static const string OLDMAIN_SUFFIX = ".OLDMAIN";
 
+	struct ThreadCFGTask;
+
 	struct MaxSlicing: public ModulePass {
 		enum EdgeType {
 			EDGE_CALL,
@@ -39,6 +42,56 @@ namespace slicer {
 		typedef InstPair Edge;
 		typedef DenseSet<Edge> EdgeSet;
 		typedef map<int, InstList> Trace;
+		/**
+		 * The instructions and the edges visited in a trunk. 
+		 * Sorted by instruction IDs, so that the cloned program doesn't
+		 * depend on where they were computed. 
+		 */
+		struct TrunkCFG {
+			InstList nodes;
+			vector<Edge> edges;
+		};
+		// A trunk is determined by its start, its end and the call stack
+		// at its start. 
+		typedef pair<InstPair, InstList> TrunkKey;
+		struct TrunkMemo {
+			TrunkCFG trunk;
+			// The call stack at the end of the trunk. 
+			InstList end_call_stack;
+		};
+		/**
+		 * The CFG of the cloned program. Each cloned instruction gets a dense
+		 * ID when it is added. Edges are buffered until <finalize>, which
+		 * lays out the successors and the predecessors of all instructions
+		 * in two flat arrays indexed by the IDs. 
+		 */
+		struct ClonedCFG {
+			ClonedCFG(): finalized(false) {}
+			void clear();
+			void add_node(Instruction *x);
+			void add_edge(Instruction *x, Instruction *y);
+			/**
+			 * Builds the adjacency arrays. No node or edge can be added
+			 * afterwards. 
+			 */
+			void finalize();
+			ArrayRef<Instruction *> successors(Instruction *x) const;
+			ArrayRef<Instruction *> predecessors(Instruction *x) const;
+
+		private:
+			void build_rows(bool reversed, vector<unsigned> &offsets,
+					InstList &targets) const;
+			ArrayRef<Instruction *> get_row(Instruction *x,
+					const vector<unsigned> &offsets, const InstList &targets) const;
+
+			DenseMap<Instruction *, unsigned> ids;
+			vector<pair<unsigned, unsigned> > edges;
+			// Row i of the successors is
+			// succs[succ_offsets[i], succ_offsets[i + 1]). 
+			vector<unsigned> succ_offsets, pred_offsets;
+			InstList succs, preds;
+			bool finalized;
+		};
 
 		static char ID;
 		MaxSlicing();
@@ -60,11 +113,13 @@ namespace slicer {
 		static BasicBlock *create_unreachable(Function *f);
 
 	private:
+		friend struct ThreadCFGTask;
+
 		/**
 		 * <trace> and <landmarks> will be updated. 
 		 */
 		void read_trace_and_landmarks();
-		void dump_thr_cfg(const CFG &cfg, int thr_id);
+		void dump_thr_cfg(int thr_id);
 		void link_thr_funcs(Module &M);
 		void link_thr_func(Module &M,
 				int parent_tid, size_t trunk_id, int child_tid);
@@ -77,20 +132,39 @@ namespace slicer {
 		 */
 		void build_cfg(Module &M);
 		/*
-		 * <cfg> and <parent> are shared by all threads.
-		 * Do *not* clear them in this function. 
+		 * Computes the TrunkCFG of each trunk in a thread except the last
+		 * one. Only reads the original program, so threads can be computed
+		 * in separate workers. 
+		 * Returns the number of trunks whose CFGs are reused from
+		 * <trunk_cache>. 
 		 */
-		void build_cfg_of_thread(Module &M, int thr_id);
+		unsigned compute_cfg_of_thread(int thr_id, vector<TrunkCFG> &trunks);
 		/**
-		 * Build the CFG of a particular trunk. 
+		 * Computes the CFG of a particular trunk. 
 		 * [start, end] indicates the range of the trunk.
 		 *
 		 * <call_stack> should contain the calling context of <start>
 		 * when calling this function. It will contain the calling context
 		 * of <end> after this function returns. 
 		 */
+		void compute_cfg_of_trunk(Instruction *start, Instruction *end,
+				InstList &call_stack, TrunkCFG &trunk);
+		// Encodes/decodes TrunkCFGs with instruction IDs. 
+		void encode_trunk_cfgs(const vector<TrunkCFG> &trunks,
+				vector<unsigned> &ids);
+		void decode_trunk_cfgs(const vector<unsigned> &ids,
+				vector<TrunkCFG> &trunks);
+		/*
+		 * <cfg> and <parent> are shared by all threads.
+		 * Do *not* clear them in this function. 
+		 */
+		void build_cfg_of_thread(Module &M, int thr_id,
+				const vector<TrunkCFG> &trunks);
+		/**
+		 * Clones the instructions in <trunk> and adds its edges to <cfg>. 
+		 */
 		void build_cfg_of_trunk(Instruction *start, Instruction *end,
-				int thr_id, size_t trunk_id, InstList &call_stack);
+				int thr_id, size_t trunk_id, const TrunkCFG &trunk);
 		/*
 		 * Create the cloned instruction, and
 		 * link the original instruction and the cloned instruction
@@ -98,25 +172,47 @@ namespace slicer {
 		 */
 		void create_and_link_cloned_inst(
 				int thr_id, size_t trunk_id, Instruction *orig);
+		/**
+		 * An instruction being visited by <dfs>. 
+		 * <succs> are the successors to move on to. A call pushes <x> to the
+		 * call stack, and a return pops <ret_addr> from the call stack, until
+		 * the frame is done. 
+		 */
+		struct DFSFrame {
+			DFSFrame(Instruction *ins):
+				x(ins), next(0), is_call(false), ret_addr(NULL) {}
+			Instruction *x;
+			InstList succs;
+			size_t next;
+			bool is_call;
+			Instruction *ret_addr;
+		};
 		/**
 		 * DFS algorithm used in reachability analysis. 
 		 * This one exploits the call stack and is different from
 		 * the standard one.
+		 * Uses an explicit stack of DFSFrames instead of recursion, because
+		 * a trunk can contain millions of instructions. 
 		 *
 		 * <end_call_stack> records the calling context when reaching <end>. 
 		 */
 		void dfs(Instruction *x, Instruction *end,
 				InstSet &visited_nodes, EdgeSet &visited_edges,
 				InstList &call_stack, InstList &end_call_stack);
+		/*
+		 * Computes the successors of frame.x under <call_stack>, and updates
+		 * <call_stack> as if entering the frame. 
+		 */
+		void enter_dfs_frame(DFSFrame &frame, InstList &call_stack);
 		/*
 		 * A common function used in DFS.
-		 * Modifies visited_nodes and visited_edges,
-		 * and calls DFS recursively. 
+		 * Modifies visited_nodes and visited_edges.
+		 * Returns whether DFS should continue from <y>. 
 		 */
-		void move_on(Instruction *x, Instruction *y,
+		bool move_on(Instruction *x, Instruction *y,
 				Instruction *end,
 				InstSet &visited_nodes, EdgeSet &visited_edges,
-				InstList &call_stack, InstList &end_call_stack);
+				const InstList &call_stack, InstList &end_call_stack);
 		/*
 		 * Assign each instruction a containing BB and a containing function. 
 		 * We calculate the assignment of an instruction according to its
@@ -125,6 +221,7 @@ namespace slicer {
 		 * This function needs to DFS the CFG. <start> indicates the start point,
 		 * which should be the start point of a thread, i.e. the main entry or 
 		 * the entry to a thread function.
+		 * Requires <cfg> to be finalized. 
 		 */
 		void assign_containers(Module &M, Instruction *x);
 		void assign_container(Module &M, Instruction *x,
@@ -216,8 +313,8 @@ namespace slicer {
 		// the cloned program. However, there can be at most one of them in each
 		// trunk. Therefore, each trunk has a clone map.
 		map<int, vector<InstMapping> > clone_map;
-		// CFG and reversed CFG
-		CFG cfg, cfg_r;
+		// CFG of the cloned program. 
+		ClonedCFG cfg;
 		// The real successors of an InvokeInst, which are at the same level.
 		// Does not include InvokeInsts whose successors in <cfg> are already
 		// real successors. 
@@ -232,6 +329,10 @@ namespace slicer {
 		 * <reach_end> has a similar meaning. 
 		 */
 		ConstInstSet reach_start, reach_end;
+		// Trunks computed so far. Identical trunks, e.g. loop iterations
+		// around the same landmark, are computed only once. With
+		// -max-slicing-jobs, each worker fills its own copy. 
+		map<TrunkKey, TrunkMemo> trunk_cache;
 	};
 }
 
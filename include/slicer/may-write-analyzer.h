@@ -7,6 +7,7 @@
 
 #include "llvm/Pass.h"
 #include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/ADT/DenseSet.h"
 using namespace llvm;
 
 #include "rcs/typedefs.h"
@@ -28,16 +29,70 @@ namespace slicer {
 		 * <region_may_write>. 
 		 */
 		bool may_write(const Instruction *i, const Value *q,
-				ConstFuncSet &visited_funcs, bool trace_callee = true);
-		bool may_write(const Function *f, const Value *q,
-				ConstFuncSet &visited_funcs, bool trace_callee = true);
+				bool trace_callee = true);
+		bool may_write(const Function *f, const Value *q);
 		/**
 		 * Check if an external call <cs> may write to <q>.
 		 */
 		bool libcall_may_write(const CallSite &cs, const Value *q);
+		/**
+		 * Summarizes what <insts> may write to, tracing into the callees in
+		 * the same way as <may_write>. Returns the ID of the summary. 
+		 */
+		unsigned summarize(const ConstInstList &insts);
+		/**
+		 * Equivalent to calling may_write(i, q) on each instruction in the
+		 * summary. Negative answers are cached. 
+		 */
+		bool summary_may_write(unsigned summary_id, const Value *q);
 	
 	private:
+		/**
+		 * The mod set of a function (or an SCC of functions) or a list of
+		 * instructions: the pointers they write to directly, and the
+		 * summaries of the callees they trace into. 
+		 */
+		struct ModSummary {
+			ConstValueList pointers;
+			vector<unsigned> callees;
+		};
+
 		bool may_alias(const Value *v1, const Value *v2);
+		void get_libcall_written_pointers(const CallSite &cs,
+				ConstValueList &pointers);
+		/**
+		 * Returns the internal functions <i> may call that <may_write>
+		 * traces into. 
+		 */
+		void get_traced_callees(const Instruction *i,
+				vector<const Function *> &traced);
+		/**
+		 * Adds the pointers <i> writes to directly to <pointers>. 
+		 */
+		void add_written_pointers(const Instruction *i,
+				ConstValueList &pointers);
+		/**
+		 * Summarizes the functions bottom-up in the SCC order of the call
+		 * graph. Functions in the same SCC share one summary. 
+		 */
+		void summarize_functions(Module &M);
+		void summarize_scc(const Function *f,
+				DenseMap<const Function *, unsigned> &dfn,
+				DenseMap<const Function *, unsigned> &low,
+				vector<const Function *> &stack, ConstFuncSet &on_stack);
+		unsigned add_summary(const ConstValueSet &pointers,
+				const DenseSet<unsigned> &callees);
+
+		vector<ModSummary> summaries;
+		DenseMap<const Function *, unsigned> func_summaries;
+		/**
+		 * (summary, q) pairs where the summary cannot write to <q>. 
+		 * AdvancedAlias keeps its not-may answers across iterations, so
+		 * these never become stale. Positive answers are not cached: they
+		 * may change, and CaptureConstraints needs to see them reach
+		 * AdvancedAlias to tell whether a capture can be reused. 
+		 */
+		DenseSet<pair<unsigned, const Value *> > not_written;
 	};
 }
 
@@ -0,0 +1,64 @@
+/**
+ * Author: Jingyue
+ *
+ * Caches the results of provable-queries issued to SolveConstraints.
+ *
+ * A query is identified by a canonical string that consists of
+ * 1. the fingerprint of the module and the captured constraints, because
+ *    the solver state depends on both, and
+ * 2. the query clause after <replace_with_root> plus everything <realize>
+ *    looks at (the users of the uses, the calling contexts and the
+ *    contexts).
+ * Since the key does not contain any pointer, the cache can be saved to
+ * disk and reused by later runs on the same bitcode.
+ *
+ * The file is rewritten as a whole and renamed into place, so concurrent
+ * runs never see a partial file. If two runs save at the same time, the
+ * entries of one of them may be lost, which only costs a recomputation.
+ */
+
+#ifndef __SLICER_QUERY_CACHE_H
+#define __SLICER_QUERY_CACHE_H
+
+#include <istream>
+#include <string>
+using namespace std;
+
+#include "llvm/ADT/StringMap.h"
+using namespace llvm;
+
+namespace slicer {
+	struct QueryCache {
+		QueryCache(): modified(false) {}
+		/**
+		 * Returns true and sets <res> if <key> is in the cache.
+		 */
+		bool lookup(const string &key, bool &res) const;
+		void insert(const string &key, bool res);
+		void clear();
+		size_t size() const { return results.size(); }
+		/**
+		 * Loads the entries saved by <save>. Returns false if <file_name>
+		 * cannot be opened.
+		 */
+		bool load(const string &file_name);
+		/**
+		 * Merges the entries in memory with the ones currently in
+		 * <file_name>, and writes back those whose keys start with
+		 * <prefix>. Entries of other modules are dropped this way, so that
+		 * the file doesn't grow forever.
+		 * Does nothing if no entry is added since the last <load>.
+		 * Returns false if <file_name> cannot be written.
+		 */
+		bool save(const string &file_name, const string &prefix);
+
+	private:
+		static void read_entries(istream &in, StringMap<bool> &entries);
+
+		StringMap<bool> results;
+		// Whether any entry is added since the last <load> or <save>.
+		bool modified;
+	};
+}
+
+#endif
@@ -1,14 +1,20 @@
 #ifndef __SLICER_QUERY_GEN_H
 #define __SLICER_QUERY_GEN_H
 
+#include <deque>
 #include <vector>
 using namespace std;
 
 #include "llvm/Instructions.h"
 #include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringSet.h"
 #include "rcs/typedefs.h"
 using namespace llvm;
 
+#include "slicer/region-manager.h"
+
 namespace slicer {
 	struct DynamicInstruction {
 		DynamicInstruction(int thr_id, size_t tr_id, const Instruction *i):
@@ -23,14 +29,16 @@ namespace slicer {
 			a.ins == b.ins;
 	}
 	
+	/**
+	 * <context> is the ID of the callstack in a CallingContextTree. 
+	 * 0 is the empty callstack. 
+	 */
 	struct DynamicInstructionWithContext {
 		DynamicInstructionWithContext(int thr_id, size_t tr_id,
-				const Instruction *i, const vector<DynamicInstruction> &cs):
-			di(thr_id, tr_id, i), callstack(cs) {}
-		DynamicInstructionWithContext(int thr_id, size_t tr_id,
-				const Instruction *i): di(thr_id, tr_id, i) {}
+				const Instruction *i, unsigned ctxt = 0):
+			di(thr_id, tr_id, i), context(ctxt) {}
 		DynamicInstruction di;
-		vector<DynamicInstruction> callstack;
+		unsigned context;
 	};
 }
 using namespace slicer;
@@ -57,12 +65,10 @@ namespace llvm {
 
 	template<> struct DenseMapInfo<DynamicInstructionWithContext> {
 		static inline DynamicInstructionWithContext getEmptyKey() {
-			return DynamicInstructionWithContext(0, 0, NULL,
-					vector<DynamicInstruction>());
+			return DynamicInstructionWithContext(0, 0, NULL);
 		}
 		static inline DynamicInstructionWithContext getTombstoneKey() {
-			return DynamicInstructionWithContext(-1, (size_t)-1, NULL,
-					vector<DynamicInstruction>());
+			return DynamicInstructionWithContext(-1, (size_t)-1, NULL);
 		}
 		static unsigned getHashValue(const DynamicInstructionWithContext &DIWC) {
 			return DenseMapInfo<DynamicInstruction>::getHashValue(DIWC.di);
@@ -75,15 +81,90 @@ namespace llvm {
 }
 
 namespace slicer {
+	/**
+	 * Interns callstacks. Each node represents the callstack from the root
+	 * to it, and is identified by a 32-bit ID. The same callstack always
+	 * gets the same ID, so comparing or copying a callstack is O(1). 
+	 */
+	struct CallingContextTree {
+		CallingContextTree();
+		// The empty callstack. 
+		static const unsigned Root = 0;
+		// Returns the callstack <parent> extended with <frame>. 
+		unsigned get_child(unsigned parent, const DynamicInstruction &frame);
+		unsigned get_parent(unsigned node) const;
+		// The innermost frame. <node> must not be the root. 
+		const DynamicInstruction &get_frame(unsigned node) const;
+		// From the outermost frame to the innermost one. 
+		void get_callstack(unsigned node,
+				vector<DynamicInstruction> &callstack) const;
+		size_t size() const { return parents.size(); }
+
+	private:
+		vector<unsigned> parents;
+		vector<DynamicInstruction> frames;
+		DenseMap<pair<unsigned, DynamicInstruction>, unsigned> children;
+	};
+
 	struct QueryGenerator: public ModulePass {
 		static char ID;
 
+		/**
+		 * The accessors in a region, split by whether they write. 
+		 * [start, end) are the timestamps of the bounding enforcing
+		 * landmarks; -1 and 2^40 if unbounded. 
+		 *
+		 * They are not grouped by alias class: the generated queries are
+		 * what the alias analyses answer later, so the generator can't
+		 * drop a pair by asking an alias analysis first. The only pairs
+		 * known to be useless beforehand are read-read ones. 
+		 */
+		struct RegionAccesses {
+			RegionAccesses(const Region &region):
+				r(region), start(-1), end(-1) {}
+			Region r;
+			long long start, end;
+			vector<DynamicInstructionWithContext> writers, readers;
+		};
+
 		QueryGenerator();
 		virtual bool runOnModule(Module &M);
 		virtual void getAnalysisUsage(AnalysisUsage &AU) const;
 		virtual void print(raw_ostream &O, const Module *M) const;
 
 	private:
+		// Computed once for each static instruction. 
+		struct AccessSummary {
+			unsigned n_accesses;
+			unsigned n_reads;
+		};
+
+		const AccessSummary &get_access_summary(const Instruction *ins);
+		RegionAccesses get_region_accesses(const Region &r,
+				const DenseSet<DynamicInstructionWithContext> &sls);
+		/**
+		 * Called when a region closes at an enforcing landmark or at the end
+		 * of the trace. Generates the queries between <ra> and the closed
+		 * regions in <regions> right away. 
+		 */
+		void close_region(const RegionAccesses &ra,
+				deque<RegionAccesses> &regions, unsigned &counter_for_sampling);
+		/**
+		 * Drops the closed regions that cannot be concurrent with any region
+		 * that closes later. <open_starts> contains the start timestamp of the
+		 * current region of each thread. 
+		 */
+		void discard_regions(deque<RegionAccesses> &regions,
+				const DenseMap<int, long long> &open_starts);
+		void add_region_pair(const RegionAccesses &a, const RegionAccesses &b,
+				unsigned &counter_for_sampling);
+		/**
+		 * Emits the query (a, b) unless it prints the same as another query
+		 * emitted in the current closing step or sampling skips it. 
+		 */
+		void add_query(const DynamicInstructionWithContext &a,
+				const DynamicInstructionWithContext &b,
+				unsigned &counter_for_sampling);
 		void print_dynamic_instruction(raw_ostream &O,
 				const DynamicInstruction &di) const;
 		void print_dynamic_instruction_with_context(raw_ostream &O,
@@ -93,6 +174,14 @@ namespace slicer {
 
 		vector<pair<DynamicInstructionWithContext,
 			DynamicInstructionWithContext> > all_queries;
+		DenseMap<const Instruction *, AccessSummary> access_summaries;
+		CallingContextTree contexts;
+		// Where the queries are streamed to. NULL if not streaming. 
+		raw_ostream *query_out;
+		// The printed queries emitted in the current closing step. 
+		StringSet<> emitted_queries;
+		// # of queries generated after sampling. 
+		unsigned n_queries;
 	};
 }
 
@@ -5,18 +5,18 @@
  * enforcing landmark and its next enforcing landmark. 
  *
  * A region is a set of contiguous trunks bounded by enforcing landmarks. 
- *
- * TODO: Maintain a list of regions for each thread. 
  */
 
 #ifndef __SLICER_REGION_MANAGER_H
 #define __SLICER_REGION_MANAGER_H
 
 #include "llvm/Pass.h"
+#include "llvm/ADT/SparseBitVector.h"
 #include "rcs/util.h"
 using namespace llvm;
 
 #include <vector>
+#include <map>
 using namespace std;
 
 namespace slicer {
@@ -66,10 +66,18 @@ namespace slicer {
 		virtual bool runOnModule(Module &M);
 		virtual void print(raw_ostream &O, const Module *M) const;
 
+		/**
+		 * The result is sorted by region IDs, i.e. by thread IDs and then
+		 * by timestamps. 
+		 */
 		void get_containing_regions(
 				const Instruction *ins, vector<Region> &regions) const;
 		bool region_has_insts(const Region &r) const;
-		const ConstInstList &get_insts_in_region(const Region &r) const;
+		/**
+		 * The instructions are in the order of their IDs in RegionManager. 
+		 * <insts> is cleared first. 
+		 */
+		void get_insts_in_region(const Region &r, ConstInstList &insts) const;
 		/**
 		 * Returns all regions that are concurrent with a particular region. 
 		 * This function does not involve with max-slicer actually.
@@ -86,18 +94,44 @@ namespace slicer {
 		Region next_region_in_thread(const Region &r, int thr_id) const;
 
 	private:
+		/**
+		 * The regions of one thread in the order of their timestamps. 
+		 * <starts> and <ends> are the timestamps of the enforcing landmarks
+		 * bounding each region. Both are strictly increasing.
+		 * starts[0] is unused because the first region has no start. 
+		 * The end of the last region is (unsigned)-1. 
+		 */
+		struct ThreadRegions {
+			vector<Region> regions;
+			vector<unsigned> starts;
+			vector<unsigned> ends;
+		};
+
+		void index_regions();
 		void mark_region(
 				const InstList &s_insts, const InstList &e_insts,
 				int thr_id, size_t s_tr, size_t e_tr);
 
 		void search_containing_regions(const Instruction *ins,
-				ConstInstSet &visited, vector<Region> &regions) const;
+				ConstInstSet &visited, SparseBitVector<> &regions) const;
 
-		// TODO: Using Region * would be faster. 
-		DenseMap<const Instruction *, Region> ins_region;
-		// The reverse mapping of <ins_region>. 
+		// Used by <get_concurrent_regions>. 
+		map<int, ThreadRegions> thread_regions;
+		// All regions, numbered in the order of <thread_regions>. 
+		vector<Region> all_regions;
+		DenseMap<Region, unsigned> region_ids;
+		// Instructions in the sliced part, numbered in the order they are
+		// first marked, so that a region mostly has contiguous IDs. 
+		DenseMap<const Instruction *, unsigned> ins_ids;
+		// The first region each instruction is marked in. 
+		vector<unsigned> ins_region;
+		// The reverse mapping of <ins_region>, one row per region. 
 		// Note that it does not necessarily include all instructions. 
-		DenseMap<Region, ConstInstList> region_insts;
+		vector<SparseBitVector<> > region_insts;
+		ConstInstList id_to_ins;
+		// Containing regions of the functions outside the sliced part,
+		// filled on demand. 
+		mutable DenseMap<const Function *, SparseBitVector<> > func_regions;
 	};
 }
 
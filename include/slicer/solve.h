@@ -15,6 +15,7 @@ using namespace std;
 using namespace llvm;
 
 #include "expression.h"
+#include "query-cache.h"
 
 #define Expr VCExpr
 #define Type VCType
@@ -23,6 +24,8 @@ using namespace llvm;
 #undef Type
 
 namespace slicer {
+	struct ProvableTask;
+
 	// SolveConstraints runs CaptureConstraints to capture
 	// existing constraints firstly. Then, the user may add
 	// new constraints, and ask SolveConstraints whether there's
@@ -83,8 +86,18 @@ namespace slicer {
 		bool provable(CmpInst::Predicate p,
 				const ConstInstList &c1, const T1 *v1,
 				const ConstInstList &c2, const T2 *v2);
+		/**
+		 * Batch versions. <results>[i] is the answer to <cs>[i]. 
+		 * Queries that miss the cache are split among -solver-jobs forked
+		 * workers (see worker-pool.h). 
+		 * The caller is responsible to delete the clauses. 
+		 */
+		void satisfiable(const vector<const Clause *> &cs, vector<bool> &results);
+		void provable(const vector<const Clause *> &cs, vector<bool> &results);
 
 	private:
+		friend struct ProvableTask;
+
 		/**
 		 * General functions. 
 		 */
@@ -97,7 +110,25 @@ namespace slicer {
 		 * inserts them to <vc>.
 		 */
 		void translate_captured(Module &M);
-		void check_consistency(Module &M);
+		// Returns false if the asserted constraints are inconsistent. 
+		bool check_consistency(Module &M);
+		/**
+		 * Constraint slicing. 
+		 * A query is independent of the captured constraints that share no
+		 * variable with it, directly or transitively. <translate_captured>
+		 * groups the captured constraints by the connected components of
+		 * their variables, and each query asserts only the components its
+		 * own variables and the realized constraints fall into. 
+		 * Off unless -slice-constraints. 
+		 */
+		bool should_slice_constraints() const;
+		void add_to_component_index(unsigned i, const vector<string> &vars);
+		unsigned get_var_id(const string &name);
+		unsigned get_component(unsigned var_id);
+		// Asserts the components touched by <touched_vars>. 
+		void assert_captured_in_cone();
+		void assert_all_captured();
+		void assert_captured(unsigned i);
 #if 0
 		void separate(Module &M);
 #endif
@@ -107,6 +138,9 @@ namespace slicer {
 		VCExpr translate_to_vc(const Value *v,
 				unsigned context, bool is_loop_bound = false);
 		VCExpr translate_to_vc(const Use *u, unsigned context);
+		// The name of <v>'s variable in <vc>. Empty if <v> is a constant. 
+		string get_var_name(const Value *v,
+				unsigned context, bool is_loop_bound = false);
 		/**
 		 * Used by translate_to_vc. 
 		 * Avoid numeric overflow or underflow by adding extra constraints. 
@@ -122,6 +156,33 @@ namespace slicer {
 		// If so, outputs <v1> and <v2> as well if they are not <NULL>. 
 		static bool is_simple_eq(
 				const Clause *c, const Value **v1, const Value **v2);
+		/**
+		 * Builds the key of <c> in <query_cache>. 
+		 * <rooted> is <c> after <replace_with_root>. 
+		 */
+		string get_query_key(const Clause *c, const Clause *rooted);
+		void print_realize_key(raw_ostream &O, const Clause *c);
+		void print_realize_key(raw_ostream &O, const BoolExpr *be);
+		void print_realize_key(raw_ostream &O, const Expr *e);
+		bool should_use_query_cache() const;
+		// Checks whether <rooted> is in the form of (v == v). 
+		static bool is_trivially_true(const Clause *rooted);
+		/**
+		 * Returns 1 or 0 if <c> can be answered without querying <vc>. 
+		 * Returns -1 otherwise, and sets <key> if the cache is used. 
+		 * <rooted> is <c> after <replace_with_root>. 
+		 */
+		int try_to_prove_quickly(const Clause *c, const Clause *rooted,
+				string &key);
+		// Always queries <vc>. 
+		bool query_vc(const Clause *c, const Clause *rooted);
+		/**
+		 * Same as <provable>, but takes <c> after <replace_with_root> as
+		 * well, so that the callers clone and replace it only once. 
+		 */
+		bool provable_rooted(const Clause *c, const Clause *rooted);
+		void provable_rooted(const vector<const Clause *> &cs,
+				const vector<const Clause *> &rooted, vector<bool> &results);
 		/**
 		 * Try very basic simplification on this expression. 
 		 * Returns 1 if it can be simplified as true. 
@@ -203,6 +264,21 @@ namespace slicer {
 		void realize(const Function *f, unsigned context);
 		void realize(const ConstInstList &callstack,
 				const Value *v, unsigned context);
+		/**
+		 * Realizes the call instructions and the call edges in <callstack>. 
+		 * Part of realize(callstack, v, context). 
+		 */
+		void realize_calling_context(const ConstInstList &callstack,
+				unsigned context);
+		/**
+		 * Realizes the calling contexts of all values in <c>, so that
+		 * queries under the same calling contexts can share them. 
+		 */
+		void realize_calling_contexts(const Clause *c);
+		void realize_calling_contexts(const Expr *e);
+		// Used to group queries under the same calling contexts. 
+		void print_calling_contexts(raw_ostream &O, const Clause *c);
+		void print_calling_contexts(raw_ostream &O, const Expr *e);
 		/**
 		 * Realizes a function call from <ins> to <f>.
 		 * <ins> must be a CallInst/InvokeInst. 
@@ -233,6 +309,39 @@ namespace slicer {
 		/* NOTE: <root> may contain some constants that don't appeared in CC. */
 		ConstValueMapping root;
 		DenseMap<ConstValuePair, bool> may_eq_cache, must_eq_cache;
+		/**
+		 * Results of provable-queries. Shared across <recalculate>s,
+		 * because the keys contain <state_fingerprint>. 
+		 */
+		QueryCache query_cache;
+		// Fingerprint of the module, shared with CaptureConstraints. Computed
+		// only if the cache is persistent. 
+		long module_fingerprint;
+		// Every key in <query_cache> starts with it. 
+		string get_module_key_prefix() const;
+		// Identifies the constraints currently in <vc>. 
+		string state_fingerprint;
+		/**
+		 * Set when a batch has realized the calling contexts of the current
+		 * queries. <realize> skips them then. 
+		 */
+		bool calling_contexts_realized_;
+		/**
+		 * The index of constraint slicing. <var_parent> is a union-find
+		 * forest over the variables in <var_ids>. 
+		 */
+		StringMap<unsigned> var_ids;
+		vector<unsigned> var_parent;
+		// Non-trivial captured constraints, grouped by their components. 
+		DenseMap<unsigned, vector<unsigned> > component_constraints;
+		// Non-trivial captured constraints without any variable. 
+		vector<unsigned> ground_constraints;
+		/**
+		 * When <recording_vars_> is set, <translate_to_vc> appends each
+		 * variable it creates to <touched_vars>. 
+		 */
+		bool recording_vars_;
+		vector<string> touched_vars;
 		bool print_counterexample_;
 		bool print_asserts_;
 		bool print_minimal_proof_set_;
@@ -0,0 +1,178 @@
+/**
+ * Author: Jingyue
+ *
+ * On-disk format of the full trace.
+ *
+ * The file starts with a TraceFileHeader, followed by blocks. Each block
+ * holds the records one thread flushed at once: a TraceBlockHeader and
+ * then <n_bytes> bytes of encoded records. Since all records in a block
+ * come from the same thread, the raw thread ID is stored once in the block
+ * header. Each record is encoded as
+ *   varint(zigzag(ins_id - prev_ins_id) << 1 | has_child)
+ *   varint(timestamp - prev_timestamp)
+ *   varint(raw_child_tid) if has_child
+ * where prev_ins_id starts from 0 and prev_timestamp starts from the
+ * block's <first_timestamp>.
+ *
+ * Header-only, because the tracing runtime is compiled on its own.
+ */
+
+#ifndef __SLICER_TRACE_FORMAT_H
+#define __SLICER_TRACE_FORMAT_H
+
+#include <cstring>
+#include <vector>
+
+#include "trace.h"
+
+namespace slicer {
+	const static char TRACE_MAGIC[4] = {'S', 'L', 'T', 'R'};
+	const static unsigned TRACE_VERSION = 1;
+	// The maximum # of bytes one encoded record takes.
+	const static unsigned MAX_ENCODED_RECORD_SIZE = 10 + 5 + 10;
+
+	struct TraceFileHeader {
+		char magic[4];
+		unsigned version;
+	};
+
+	struct TraceBlockHeader {
+		unsigned long raw_tid;
+		unsigned n_records;
+		unsigned first_timestamp;
+		// # of bytes of the encoded records following the header.
+		unsigned n_bytes;
+	};
+
+	inline void init_trace_file_header(TraceFileHeader &header) {
+		memcpy(header.magic, TRACE_MAGIC, sizeof TRACE_MAGIC);
+		header.version = TRACE_VERSION;
+	}
+
+	inline bool is_valid_trace_file_header(const TraceFileHeader &header) {
+		return memcmp(header.magic, TRACE_MAGIC, sizeof TRACE_MAGIC) == 0 &&
+			header.version == TRACE_VERSION;
+	}
+
+	inline char *write_varint(char *p, unsigned long value) {
+		while (value >= 0x80) {
+			*p++ = (char)(value | 0x80);
+			value >>= 7;
+		}
+		*p++ = (char)value;
+		return p;
+	}
+
+	inline const char *read_varint(const char *p, unsigned long &value) {
+		value = 0;
+		unsigned shift = 0;
+		unsigned char byte;
+		do {
+			byte = (unsigned char)*p++;
+			value |= (unsigned long)(byte & 0x7f) << shift;
+			shift += 7;
+		} while (byte & 0x80);
+		return p;
+	}
+
+	/*
+	 * Encodes <n_records> records of the same thread into <out>, which must
+	 * have at least n_records * MAX_ENCODED_RECORD_SIZE bytes.
+	 * Fills in <header> and returns the end of the encoded records.
+	 */
+	inline char *encode_trace_block(const TraceRecord *records,
+			unsigned n_records, TraceBlockHeader &header, char *out) {
+		header.raw_tid = (n_records > 0 ? records[0].raw_tid : INVALID_RAW_TID);
+		header.n_records = n_records;
+		header.first_timestamp = (n_records > 0 ? records[0].timestamp : 0);
+		unsigned prev_ins_id = 0, prev_timestamp = header.first_timestamp;
+		char *p = out;
+		for (unsigned i = 0; i < n_records; ++i) {
+			const TraceRecord &record = records[i];
+			long delta = (long)record.ins_id - (long)prev_ins_id;
+			unsigned long zigzag = ((unsigned long)delta << 1) ^
+				(unsigned long)(delta >> 63);
+			bool has_child = (record.raw_child_tid != INVALID_RAW_TID);
+			p = write_varint(p, zigzag << 1 | (has_child ? 1 : 0));
+			p = write_varint(p, record.timestamp - prev_timestamp);
+			if (has_child)
+				p = write_varint(p, record.raw_child_tid);
+			prev_ins_id = record.ins_id;
+			prev_timestamp = record.timestamp;
+		}
+		header.n_bytes = p - out;
+		return p;
+	}
+
+	/*
+	 * Decodes the records of one block one by one.
+	 * <block> points to the block header, which may be unaligned.
+	 */
+	struct TraceBlockDecoder {
+		// Decodes nothing until assigned a real decoder.
+		TraceBlockDecoder(): p(NULL), n_decoded(0), prev_ins_id(0),
+			prev_timestamp(0) {
+			memset(&header, 0, sizeof header);
+		}
+		TraceBlockDecoder(const char *block): n_decoded(0), prev_ins_id(0) {
+			memcpy(&header, block, sizeof header);
+			p = block + sizeof header;
+			prev_timestamp = header.first_timestamp;
+		}
+
+		// Returns false if all records in the block have been decoded.
+		bool next(TraceRecord &record) {
+			if (n_decoded >= header.n_records)
+				return false;
+			unsigned long value;
+			p = read_varint(p, value);
+			bool has_child = (value & 1);
+			unsigned long zigzag = value >> 1;
+			long delta = (long)(zigzag >> 1) ^ -(long)(zigzag & 1);
+			record.ins_id = (unsigned)((long)prev_ins_id + delta);
+			p = read_varint(p, value);
+			record.timestamp = prev_timestamp + (unsigned)value;
+			record.raw_tid = header.raw_tid;
+			record.raw_child_tid = INVALID_RAW_TID;
+			if (has_child)
+				p = read_varint(p, record.raw_child_tid);
+			prev_ins_id = record.ins_id;
+			prev_timestamp = record.timestamp;
+			++n_decoded;
+			return true;
+		}
+
+		TraceBlockHeader header;
+		const char *p;
+		unsigned n_decoded;
+		unsigned prev_ins_id, prev_timestamp;
+	};
+
+	/*
+	 * Splits a whole trace file in memory into blocks.
+	 * Returns false if the file is not a valid trace.
+	 */
+	inline bool index_trace_blocks(const char *start, size_t size,
+			std::vector<const char *> &blocks) {
+		if (size < sizeof(TraceFileHeader))
+			return false;
+		TraceFileHeader file_header;
+		memcpy(&file_header, start, sizeof file_header);
+		if (!is_valid_trace_file_header(file_header))
+			return false;
+		size_t offset = sizeof(TraceFileHeader);
+		while (offset < size) {
+			if (offset + sizeof(TraceBlockHeader) > size)
+				return false;
+			TraceBlockHeader header;
+			memcpy(&header, start + offset, sizeof header);
+			if (offset + sizeof(TraceBlockHeader) + header.n_bytes > size)
+				return false;
+			blocks.push_back(start + offset);
+			offset += sizeof(TraceBlockHeader) + header.n_bytes;
+		}
+		return true;
+	}
+}
+
+#endif
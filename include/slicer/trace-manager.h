@@ -15,6 +15,8 @@
 #include "llvm/Pass.h"
 #include "llvm/Module.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/Support/MemoryBuffer.h"
 using namespace llvm;
 
 #include <map>
@@ -22,6 +24,7 @@ using namespace llvm;
 using namespace std;
 
 #include "trace.h"
+#include "trace-format.h"
 using namespace slicer;
 
 namespace slicer {
@@ -42,24 +45,84 @@ namespace slicer {
 		virtual bool runOnModule(Module &M);
 		virtual void print(raw_ostream &O, const Module *M) const;
 		virtual void getAnalysisUsage(AnalysisUsage &AU) const;
-		const TraceRecord &get_record(unsigned idx) const;
-		const TraceRecordInfo &get_record_info(unsigned idx) const;
+		virtual void releaseMemory();
+		/**
+		 * The records stay compressed in the memory-mapped trace file (see
+		 * trace-format.h), and are decoded on demand. There's no decoded
+		 * record to point to, so the record is returned by value. 
+		 * <idx> is the position in the total order, and the returned
+		 * record's timestamp is <idx>. 
+		 * Consecutive <idx>s take amortized O(log # of threads) time. Other
+		 * jumps take O(# of threads * CheckpointInterval) time. 
+		 */
+		TraceRecord get_record(unsigned idx) const;
+		// Computed on demand as well. 
+		TraceRecordInfo get_record_info(unsigned idx) const;
 		unsigned get_num_records() const;
-		// Used by the trace converter. 
-		bool write_record(ostream &fout, const TraceRecord &record) const;
 
 	private:
+		// A thread's records are decodable from every CheckpointInterval-th one.
+		static const unsigned CheckpointInterval = 256;
+
 		/**
-		 * Returns true if we successfully get a trace record. 
-		 * fin must be opened in the binary mode.
+		 * Where to resume decoding the records of a thread. 
+		 * <timestamp> is the timestamp of the record at <p>. 
 		 */
-		bool read_record(istream &fin, TraceRecord &record) const;
+		struct Checkpoint {
+			unsigned block;
+			const char *p;
+			unsigned n_decoded;
+			unsigned prev_ins_id, prev_timestamp;
+			unsigned timestamp;
+		};
+
+		// The blocks of a normalized thread, sorted by timestamps. 
+		struct ThreadTrace {
+			vector<const char *> blocks;
+			vector<Checkpoint> checkpoints;
+		};
+
+		// Decodes the records of a thread one by one. 
+		struct ThreadCursor {
+			ThreadCursor(): block(0), valid(false) {}
+			unsigned block;
+			TraceBlockDecoder decoder;
+			TraceRecord record;
+			bool valid;
+		};
+
+		/**
+		 * Decodes the whole trace once in the total order to normalize the
+		 * thread IDs and to build the checkpoints. Keeps nothing per record. 
+		 */
+		void index_trace(const char *start, size_t size);
 		int get_normalized_tid(unsigned long raw_tid);
-		void compute_record_infos(Module &M);
 		void validate_trace(Module &M);
+		// Returns the timestamp of the <idx>-th record in the total order. 
+		unsigned get_timestamp(unsigned idx) const;
+		static bool compare_timestamp(unsigned timestamp, const Checkpoint &cp);
+		// Moves the cursor of Thread <tid> to its first record >= <timestamp>.
+		void seek_thread(int tid, unsigned timestamp) const;
+		void advance_thread(int tid) const;
+		/**
+		 * Moves the merge state to the <idx>-th record, and returns the
+		 * normalized thread whose cursor holds the record. 
+		 */
+		int locate(unsigned idx) const;
 
-		vector<TraceRecord> records;
-		vector<TraceRecordInfo> record_infos;
+		// The memory-mapped trace file. 
+		OwningPtr<MemoryBuffer> trace_buffer;
+		unsigned n_records;
+		// Indexed by normalized thread IDs. 
+		vector<ThreadTrace> threads;
+		/*
+		 * Timestamps are mostly consecutive. Each element is the position and
+		 * the timestamp of the first record of a run of consecutive
+		 * timestamps. 
+		 */
+		vector<pair<unsigned, unsigned> > runs;
+		// Normalized child thread IDs of the pthread_create records. 
+		DenseMap<unsigned, int> child_tids;
 		DenseMap<unsigned long, int> raw_tid_to_tid;
 		/**
 		 * # of used threads. 
@@ -67,6 +130,15 @@ namespace slicer {
 		 * thread IDs. 
 		 */
 		unsigned n_threads;
+
+		/*
+		 * The merge state. <heap> is a min-heap of the timestamps of the
+		 * current records of the threads, and its top is the record at
+		 * position <cur_idx>. Mutable because get_record is logically const. 
+		 */
+		mutable vector<ThreadCursor> cursors;
+		mutable vector<pair<unsigned, int> > heap;
+		mutable unsigned cur_idx;
 	};
 }
 
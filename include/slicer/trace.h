@@ -11,6 +11,15 @@ namespace slicer {
 	// Directly collected from executing the instrumented program
 	struct TraceRecord {
 		unsigned ins_id;
+		/**
+		 * Value of the global logical clock when the record is generated.
+		 * Each thread buffers its own records and flushes them in blocks, so
+		 * records of different threads interleave arbitrarily in the trace
+		 * file. TraceManager merges the records by <timestamp> to recover the
+		 * total order. Fits in the padding after <ins_id>. The tracing
+		 * runtime truncates the trace rather than letting it wrap around.
+		 */
+		unsigned timestamp;
 		unsigned long raw_tid;
 		unsigned long raw_child_tid;
 	};
@@ -0,0 +1,65 @@
+/**
+ * Author: Jingyue
+ *
+ * Runs independent tasks in forked worker processes.
+ *
+ * Neither STP nor LLVM's on-the-fly function passes (DominatorTree,
+ * LoopInfo, etc.) are thread-safe. Therefore, we parallelize with
+ * processes instead of threads. Each worker inherits a copy-on-write
+ * snapshot of the whole analysis state, including the solver preloaded
+ * with the captured constraints, so it needs no synchronization.
+ */
+
+#ifndef __SLICER_WORKER_POOL_H
+#define __SLICER_WORKER_POOL_H
+
+#include <vector>
+using namespace std;
+
+namespace slicer {
+	struct WorkerTask {
+		virtual ~WorkerTask() {}
+		/**
+		 * Called before a worker runs the tasks in [s, e). Tasks that are
+		 * cheaper to answer together can do the work here. 
+		 */
+		virtual void start(unsigned s, unsigned e) {}
+		/**
+		 * Runs the <i>-th task in a worker and returns its result.
+		 * Side effects are not visible to the parent.
+		 */
+		virtual int run(unsigned i) = 0;
+		/**
+		 * Called after a worker finishes its shard. Tasks that keep state
+		 * between consecutive run()s clean it up here.
+		 */
+		virtual void finish() {}
+	};
+
+	/**
+	 * Runs task.run(i) for each i in [0, n) and stores the results in
+	 * order in <results>. The tasks are split into at most <n_jobs>
+	 * contiguous shards, one for each worker. Runs in the current process
+	 * if n_jobs <= 1 or fork fails.
+	 * If <shard_times> is not NULL, stores the seconds each shard took. 
+	 */
+	void run_in_workers(WorkerTask &task, unsigned n, unsigned n_jobs,
+			vector<int> &results, vector<double> *shard_times = NULL);
+
+	/**
+	 * A task whose result is a list of integers, e.g. a set of
+	 * instruction IDs. 
+	 */
+	struct ListWorkerTask {
+		virtual ~ListWorkerTask() {}
+		virtual void run(unsigned i, vector<unsigned> &result) = 0;
+	};
+
+	/**
+	 * The same as the one above, but for ListWorkerTasks. 
+	 */
+	void run_in_workers(ListWorkerTask &task, unsigned n, unsigned n_jobs,
+			vector<vector<unsigned> > &results);
+}
+
+#endif
@@ -25,6 +25,7 @@ using namespace rcs;
 #include "slicer/adv-alias.h"
 #include "slicer/solve.h"
 #include "slicer/clone-info-manager.h"
+#include "slicer/worker-pool.h"
 #include "pointer-access.h"
 using namespace slicer;
 
@@ -36,6 +37,9 @@ static cl::opt<bool> Cloned("cloned",
 		cl::desc("Whether the input program is a sliced/simplified program"));
 static cl::opt<bool> LoadLoad("driver-loadload",
 		cl::desc("The query driver considers load-load aliases as well"));
+static cl::opt<unsigned> Jobs("jobs",
+		cl::desc("# of forked workers answering the queries"),
+		cl::init(1));
 
 char QueryDriver::ID = 0;
 
@@ -67,60 +71,110 @@ static inline double time_diff(timeb time1, timeb time0) {
 		0.001 * (time1.millitm - time0.millitm);
 }
 
+namespace slicer {
+	/*
+	 * Answers the flattened alias queries of QueryDriver. Each worker
+	 * answers a contiguous shard. With the advanced AA, a shard is issued
+	 * as one batch so that the queries share the solver work. 
+	 * See worker-pool.h for why the workers are processes. 
+	 */
+	struct AliasTask: public WorkerTask {
+		AliasTask(const vector<AliasQuery> &q, AdvancedAlias *aaa,
+				AliasAnalysis *baa):
+			queries(q), AAA(aaa), BAA(baa), shard_start(0) {}
+
+		virtual void start(unsigned s, unsigned e) {
+			if (AAA) {
+				vector<AliasQuery> shard(queries.begin() + s, queries.begin() + e);
+				AAA->alias(shard, shard_results);
+				shard_start = s;
+			}
+		}
+
+		virtual int run(unsigned i) {
+			if (AAA) {
+				assert(i - shard_start < shard_results.size());
+				return shard_results[i - shard_start];
+			}
+			return BAA->alias(queries[i].v1, 0, queries[i].v2, 0);
+		}
+
+		virtual void finish() {
+			shard_results.clear();
+		}
+
+	private:
+		const vector<AliasQuery> &queries;
+		AdvancedAlias *AAA;
+		AliasAnalysis *BAA;
+		unsigned shard_start;
+		vector<AliasAnalysis::AliasResult> shard_results;
+	};
+}
+
 void QueryDriver::issue_queries() {
 	timeb start_time;
 	timeb end_time;
 
 	errs() << "# of queries = " << queries.size() << "\n";
 
+	// Flatten the queries into alias queries on the pointer accesses. 
+	// <first_alias_query>[i] is the first alias query of queries[i]. 
+	vector<AliasQuery> alias_queries;
+	vector<size_t> first_alias_query;
+	for (size_t i = 0; i < queries.size(); ++i) {
+		first_alias_query.push_back(alias_queries.size());
+		const Instruction *i1 = queries[i].first.ins;
+		const Instruction *i2 = queries[i].second.ins;
+		if (!i1 || !i2)
+			continue;
+		for (size_t j = 0; j < queries[i].first.callstack.size(); ++j)
+			assert(is_call(queries[i].first.callstack[j]));
+		for (size_t j = 0; j < queries[i].second.callstack.size(); ++j)
+			assert(is_call(queries[i].second.callstack[j]));
+		vector<PointerAccess> accesses1 = get_pointer_accesses(i1);
+		vector<PointerAccess> accesses2 = get_pointer_accesses(i2);
+		for (size_t j1 = 0; j1 < accesses1.size(); ++j1) {
+			for (size_t j2 = 0; j2 < accesses2.size(); ++j2) {
+				if (LoadLoad || racy(accesses1[j1], accesses2[j2])) {
+					alias_queries.push_back(AliasQuery(
+								queries[i].first.callstack, accesses1[j1].loc,
+								queries[i].second.callstack, accesses2[j2].loc));
+				}
+			}
+		}
+	}
+	first_alias_query.push_back(alias_queries.size());
+
+	// Answer them in <Jobs> shards, and merge the results in order. 
+	AliasTask task(alias_queries,
+			(UseAdvancedAA ? &getAnalysis<AdvancedAlias>() : NULL),
+			(UseAdvancedAA ? NULL : &getAnalysis<AliasAnalysis>()));
+	vector<int> alias_results;
+	vector<double> shard_times;
+	ftime(&start_time);
+	run_in_workers(task, alias_queries.size(), Jobs, alias_results,
+			&shard_times);
+	ftime(&end_time);
+	total_time += time_diff(end_time, start_time);
+	for (size_t w = 0; w < shard_times.size(); ++w) {
+		size_t s = alias_queries.size() * w / shard_times.size();
+		size_t e = alias_queries.size() * (w + 1) / shard_times.size();
+		errs() << "Shard " << w << ": " << e - s << " queries in "
+			<< shard_times[w] << " sec";
+		if (shard_times[w] > 0)
+			errs() << " (" << (e - s) / shard_times[w] << " queries/sec)";
+		errs() << "\n";
+	}
+
 	DenseSet<pair<unsigned, unsigned> > race_reports;
 	for (size_t i = 0; i < queries.size(); ++i) {
 		const Instruction *i1 = queries[i].first.ins, *i2 = queries[i].second.ins;
 		if (!i1 || !i2) {
 			results.push_back(AliasAnalysis::NoAlias);
 		} else {
-			vector<PointerAccess> accesses1 = get_pointer_accesses(i1);
-			vector<PointerAccess> accesses2 = get_pointer_accesses(i2);
-			if (UseAdvancedAA) {
-				AdvancedAlias &AAA = getAnalysis<AdvancedAlias>();
-				for (size_t j1 = 0; j1 < accesses1.size(); ++j1) {
-					for (size_t j2 = 0; j2 < accesses2.size(); ++j2) {
-						if (LoadLoad || racy(accesses1[j1], accesses2[j2])) {
-							ftime(&start_time);
-							results.push_back(AAA.alias(
-										queries[i].first.callstack, accesses1[j1].loc,
-										queries[i].second.callstack, accesses2[j2].loc));
-							ftime(&end_time);
-							total_time += time_diff(end_time, start_time);
-						}
-					}
-				}
-			} else {
-				AliasAnalysis &BAA = getAnalysis<AliasAnalysis>();
-				vector<User *> ctxt1, ctxt2;
-				for (size_t j = 0; j < queries[i].first.callstack.size(); ++j) {
-					const Instruction *frame = queries[i].first.callstack[j];
-					assert(is_call(frame));
-					ctxt1.push_back(const_cast<Instruction *>(frame));
-				}
-				for (size_t j = 0; j < queries[i].second.callstack.size(); ++j) {
-					const Instruction *frame = queries[i].second.callstack[j];
-					assert(is_call(frame));
-					ctxt2.push_back(const_cast<Instruction *>(frame));
-				}
-				for (size_t j1 = 0; j1 < accesses1.size(); ++j1) {
-					for (size_t j2 = 0; j2 < accesses2.size(); ++j2) {
-						if (LoadLoad || racy(accesses1[j1], accesses2[j2])) {
-							ftime(&start_time);
-							results.push_back(BAA.alias(
-										accesses1[j1].loc ,0,
-										accesses2[j2].loc, 0));
-							ftime(&end_time);
-							total_time += time_diff(end_time, start_time);
-						}
-					}
-				}
-			} // if UseAdvancedAA
+			for (size_t k = first_alias_query[i]; k < first_alias_query[i + 1]; ++k)
+				results.push_back((AliasAnalysis::AliasResult)alias_results[k]);
 			if (results.back() != AliasAnalysis::NoAlias) {
 				// Add it into the race report. 
 				unsigned ins_id_1, ins_id_2;
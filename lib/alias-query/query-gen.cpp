@@ -1,4 +1,9 @@
+#include <algorithm>
+using namespace std;
+
 #include "llvm/Support/CommandLine.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/Support/raw_ostream.h"
 #include "rcs/IDAssigner.h"
 #include "rcs/util.h"
 using namespace llvm;
@@ -25,6 +30,10 @@ static cl::opt<int> SampleRate("sample",
 		cl::desc("Sample a subset of queries: 1/sample of all queries will "
 			"be picked"),
 		cl::init(1));
+static cl::opt<string> StreamQueries("stream-queries",
+		cl::desc("Write the dynamic queries to this file as soon as each "
+			"region closes instead of keeping them in memory"),
+		cl::init(""));
 
 char QueryGenerator::ID = 0;
 
@@ -45,7 +54,182 @@ void QueryGenerator::getAnalysisUsage(AnalysisUsage &AU) const {
 		AU.addRequiredTransitive<CloneInfoManager>();
 	}
 }
-QueryGenerator::QueryGenerator(): ModulePass(ID) {
+QueryGenerator::QueryGenerator(): ModulePass(ID), query_out(NULL),
+	n_queries(0) {
+}
+
+const unsigned CallingContextTree::Root;
+
+CallingContextTree::CallingContextTree() {
+	// The root. Its frame is never used. 
+	parents.push_back(Root);
+	frames.push_back(DynamicInstruction(-1, (size_t)-1, NULL));
+}
+
+unsigned CallingContextTree::get_child(unsigned parent,
+		const DynamicInstruction &frame) {
+	assert(parent < parents.size());
+	pair<unsigned, DynamicInstruction> key(parent, frame);
+	DenseMap<pair<unsigned, DynamicInstruction>, unsigned>::iterator it =
+		children.find(key);
+	if (it != children.end())
+		return it->second;
+	unsigned node = parents.size();
+	parents.push_back(parent);
+	frames.push_back(frame);
+	children[key] = node;
+	return node;
+}
+
+unsigned CallingContextTree::get_parent(unsigned node) const {
+	assert(node != Root && node < parents.size());
+	return parents[node];
+}
+
+const DynamicInstruction &CallingContextTree::get_frame(unsigned node) const {
+	assert(node != Root && node < frames.size());
+	return frames[node];
+}
+
+void CallingContextTree::get_callstack(unsigned node,
+		vector<DynamicInstruction> &callstack) const {
+	callstack.clear();
+	for (; node != Root; node = get_parent(node))
+		callstack.push_back(get_frame(node));
+	reverse(callstack.begin(), callstack.end());
+}
+
+const QueryGenerator::AccessSummary &QueryGenerator::get_access_summary(
+		const Instruction *ins) {
+	DenseMap<const Instruction *, AccessSummary>::iterator it =
+		access_summaries.find(ins);
+	if (it != access_summaries.end())
+		return it->second;
+	AccessSummary &summary = access_summaries[ins];
+	vector<PointerAccess> accesses = get_pointer_accesses(ins);
+	summary.n_accesses = accesses.size();
+	summary.n_reads = 0;
+	for (size_t i = 0; i < accesses.size(); ++i) {
+		if (!accesses[i].is_write)
+			++summary.n_reads;
+	}
+	return summary;
+}
+
+void QueryGenerator::add_query(const DynamicInstructionWithContext &a,
+		const DynamicInstructionWithContext &b, unsigned &counter_for_sampling) {
+	string line;
+	raw_string_ostream oss(line);
+	print_dynamic_instruction_with_context(oss, a);
+	oss << ", ";
+	print_dynamic_instruction_with_context(oss, b);
+	oss << "\n";
+	oss.flush();
+	// Different dynamic instructions may print the same, e.g. without -cs. 
+	// Sample after deduplicating, so that both modes pick the same queries. 
+	if (!emitted_queries.insert(line))
+		return;
+	if ((++counter_for_sampling) % SampleRate != 0)
+		return;
+	++n_queries;
+	if (!query_out)
+		all_queries.push_back(make_pair(a, b));
+	else
+		*query_out << line;
+}
+
+QueryGenerator::RegionAccesses QueryGenerator::get_region_accesses(
+		const Region &r, const DenseSet<DynamicInstructionWithContext> &sls) {
+	LandmarkTrace &LT = getAnalysis<LandmarkTrace>();
+
+	RegionAccesses ra(r);
+	ra.start = (r.prev_enforcing_landmark == (size_t)-1 ? -1 :
+			(long long)LT.get_landmark_timestamp(
+				r.thr_id, r.prev_enforcing_landmark));
+	ra.end = (r.next_enforcing_landmark == (size_t)-1 ? 1LL << 40 :
+			(long long)LT.get_landmark_timestamp(
+				r.thr_id, r.next_enforcing_landmark));
+	for (DenseSet<DynamicInstructionWithContext>::const_iterator
+			j1 = sls.begin(); j1 != sls.end(); ++j1) {
+		const AccessSummary &summary = get_access_summary(j1->di.ins);
+		if (summary.n_reads < summary.n_accesses)
+			ra.writers.push_back(*j1);
+		else
+			ra.readers.push_back(*j1);
+	}
+	return ra;
+}
+
+static bool starts_before_end(long long start,
+		const QueryGenerator::RegionAccesses &r) {
+	return start < r.end;
+}
+
+void QueryGenerator::close_region(const RegionAccesses &ra,
+		deque<RegionAccesses> &regions, unsigned &counter_for_sampling) {
+	// Regions without any accessor generate no queries. 
+	if (ra.writers.empty() && ra.readers.empty())
+		return;
+	/*
+	 * Sweep over the closed regions. Each pair of concurrent regions is
+	 * visited exactly once, when the latter one closes. A closed region
+	 * <r1> ends before <ra> does, so they are concurrent iff <r1> ends after
+	 * <ra> starts. Regions close in the order of their ends, so <regions>
+	 * is sorted by <end>, and the concurrent ones are a suffix of it. 
+	 */
+	assert(regions.empty() || regions.back().end <= ra.end);
+	deque<RegionAccesses>::const_iterator first = upper_bound(
+			regions.begin(), regions.end(), ra.start, starts_before_end);
+	for (; first != regions.end(); ++first) {
+		if (first->r.thr_id != ra.r.thr_id)
+			add_region_pair(*first, ra, counter_for_sampling);
+	}
+	// Only deduplicate within a closing step to keep the memory bounded. 
+	emitted_queries.clear();
+	regions.push_back(ra);
+}
+
+void QueryGenerator::discard_regions(deque<RegionAccesses> &regions,
+		const DenseMap<int, long long> &open_starts) {
+	// Regions that close later start no earlier than <min_start>. 
+	long long min_start = 1LL << 40;
+	for (DenseMap<int, long long>::const_iterator it = open_starts.begin();
+			it != open_starts.end(); ++it)
+		min_start = min(min_start, it->second);
+	// <regions> is sorted by <end>, so the dead ones are a prefix. 
+	while (!regions.empty() && regions.front().end <= min_start)
+		regions.pop_front();
+}
+
+void QueryGenerator::add_region_pair(
+		const RegionAccesses &a, const RegionAccesses &b,
+		unsigned &counter_for_sampling) {
+	/*
+	 * One query per instruction pair that has an access pair in which at
+	 * least one access is a write. QueryDriver checks every access pair of
+	 * a query anyway. Read-only instructions can only pair with writers. 
+	 */
+	for (int w1 = 1; w1 >= 0; --w1) {
+		const vector<DynamicInstructionWithContext> &l1 =
+			(w1 ? a.writers : a.readers);
+		for (int w2 = 1; w2 >= 0; --w2) {
+			if (!LoadLoad && !w1 && !w2)
+				continue;
+			const vector<DynamicInstructionWithContext> &l2 =
+				(w2 ? b.writers : b.readers);
+			for (size_t j1 = 0; j1 < l1.size(); ++j1) {
+				const AccessSummary &s1 = get_access_summary(l1[j1].di.ins);
+				for (size_t j2 = 0; j2 < l2.size(); ++j2) {
+					const AccessSummary &s2 = get_access_summary(l2[j2].di.ins);
+					unsigned n_access_pairs = s1.n_accesses * s2.n_accesses;
+					if (!LoadLoad)
+						n_access_pairs -= s1.n_reads * s2.n_reads;
+					if (n_access_pairs > 0)
+						add_query(l1[j1], l2[j2], counter_for_sampling);
+				}
+			}
+		}
+	}
 }
 
 void QueryGenerator::generate_static_queries(Module &M) {
@@ -115,13 +299,36 @@ void QueryGenerator::generate_dynamic_queries(Module &M) {
 	TraceManager &TM = getAnalysis<TraceManager>();
 	EnforcingLandmarks &EL = getAnalysis<EnforcingLandmarks>();
 	LandmarkTrace &LT = getAnalysis<LandmarkTrace>();
-	RegionManager &RM = getAnalysis<RegionManager>();
 	MarkLandmarks &ML = getAnalysis<MarkLandmarks>();
 
-	DenseMap<Region, DenseSet<DynamicInstructionWithContext> > sls_in_regions;
+	/*
+	 * The queries of a region are generated as soon as the region closes,
+	 * and <regions> only keeps the closed regions that may still be
+	 * concurrent with a later region. With -stream-queries, the queries are
+	 * written right away instead of kept in <all_queries>. Both modes
+	 * generate the same queries in the same order, so -sample picks the
+	 * same ones. 
+	 */
+	string error_info;
+	raw_fd_ostream *fout = NULL;
+	if (StreamQueries != "") {
+		fout = new raw_fd_ostream(StreamQueries.c_str(), error_info);
+		assert(error_info.empty() && "Cannot open the output query file");
+	}
+	query_out = fout;
+	deque<RegionAccesses> regions;
+	unsigned n_regions = 0;
+	DenseMap<int, unsigned> num_of_accesses_in_threads;
+	// The start timestamp of the current region of each thread. 
+	DenseMap<int, long long> open_starts;
+	vector<int> thr_ids = LT.get_thr_ids();
+	for (size_t k = 0; k < thr_ids.size(); ++k)
+		open_starts[thr_ids[k]] = -1;
+
 	DenseMap<int, DenseSet<DynamicInstructionWithContext> > sls_in_cur_region;
 	DenseMap<int, const Instruction *> last_inst;
-	DenseMap<int, vector<DynamicInstruction> > last_callstack;
+	// The current callstack of each thread. Root if not found. 
+	DenseMap<int, unsigned> last_callstack;
 	DenseMap<int, size_t> last_enforcing, last_landmark;
 
 	for (unsigned i = 0; i < TM.get_num_records(); ++i) {
@@ -134,18 +341,20 @@ void QueryGenerator::generate_dynamic_queries(Module &M) {
 		if (last_inst_of_the_thread && is_call(last_inst_of_the_thread) &&
 				is_function_entry(info.ins)) {
 			assert(last_landmark_of_the_thread != (size_t)-1);
-			last_callstack[info.tid].push_back(DynamicInstruction(
-						info.tid, last_landmark_of_the_thread, last_inst_of_the_thread));
+			last_callstack[info.tid] = contexts.get_child(last_callstack[info.tid],
+					DynamicInstruction(info.tid, last_landmark_of_the_thread,
+						last_inst_of_the_thread));
 		} else if (last_inst_of_the_thread && is_ret(last_inst_of_the_thread)) {
-			if (last_callstack[info.tid].size() == 0)
+			if (last_callstack[info.tid] == CallingContextTree::Root)
 				errs() << "Error at Record " << i << "\n";
-			assert(last_callstack[info.tid].size() > 0);
-			BasicBlock::const_iterator ret_site = last_callstack[info.tid].back().ins;
-			last_callstack[info.tid].pop_back();
+			assert(last_callstack[info.tid] != CallingContextTree::Root);
+			BasicBlock::const_iterator ret_site =
+				contexts.get_frame(last_callstack[info.tid]).ins;
+			last_callstack[info.tid] = contexts.get_parent(last_callstack[info.tid]);
 			BasicBlock::const_iterator ins = ret_site;
 			const BasicBlock *bb = ins->getParent();
 			for (++ins; info.ins != ins && ins != bb->end(); ++ins) {
-				if (!get_pointer_accesses(ins).empty()) {
+				if (get_access_summary(ins).n_accesses > 0) {
 					assert(last_landmark_of_the_thread != (size_t)-1);
 					sls_in_cur_region[info.tid].insert(DynamicInstructionWithContext(
 								info.tid, last_landmark_of_the_thread, ins,
@@ -156,7 +365,7 @@ void QueryGenerator::generate_dynamic_queries(Module &M) {
 			const BasicBlock *bb = last_inst_of_the_thread->getParent();
 			for (BasicBlock::const_iterator ins = last_inst_of_the_thread;
 					info.ins != ins && ins != bb->end(); ++ins) {
-				if (!get_pointer_accesses(ins).empty()) {
+				if (get_access_summary(ins).n_accesses > 0) {
 					assert(last_landmark_of_the_thread != (size_t)-1);
 					sls_in_cur_region[info.tid].insert(DynamicInstructionWithContext(
 								info.tid, last_landmark_of_the_thread, ins,
@@ -176,9 +385,15 @@ void QueryGenerator::generate_dynamic_queries(Module &M) {
 				if (last_enforcing.count(info.tid))
 					last_enforcing_of_the_thread = last_enforcing[info.tid];
 				Region cur_region(info.tid, last_enforcing_of_the_thread, trunk_id);
-				sls_in_regions[cur_region] = sls_in_cur_region[info.tid];
+				num_of_accesses_in_threads[info.tid] +=
+					sls_in_cur_region[info.tid].size();
+				close_region(get_region_accesses(cur_region,
+							sls_in_cur_region[info.tid]), regions, counter_for_sampling);
+				++n_regions;
 				sls_in_cur_region[info.tid].clear();
 				last_enforcing[info.tid] = trunk_id;
+				open_starts[info.tid] = LT.get_landmark_timestamp(info.tid, trunk_id);
+				discard_regions(regions, open_starts);
 			}
 		}
 	}
@@ -191,55 +406,23 @@ void QueryGenerator::generate_dynamic_queries(Module &M) {
 			if (last_enforcing.count(itr->first))
 				last_enforcing_of_the_thread = last_enforcing[itr->first];
 			Region cur_region(itr->first, last_enforcing_of_the_thread, (size_t)-1);
-			sls_in_regions[cur_region] = itr->second;
+			num_of_accesses_in_threads[itr->first] += itr->second.size();
+			close_region(get_region_accesses(cur_region, itr->second),
+					regions, counter_for_sampling);
+			++n_regions;
 			itr->second.clear();
 		}
 	}
 
-	// Look at each pair of concurrent regions.
-	// TODO: Make it faster
-	errs() << "# of regions = " << sls_in_regions.size() << "\n";
-	for (DenseMap<Region, DenseSet<DynamicInstructionWithContext> >::iterator
-			i1 = sls_in_regions.begin(); i1 != sls_in_regions.end(); ++i1) {
-		DenseMap<Region, DenseSet<DynamicInstructionWithContext> >::iterator i2 = i1;
-		if (!LoadLoad) {
-			++i2;
-		}
-		for (; i2 != sls_in_regions.end(); ++i2) {
-			if (LoadLoad || RM.concurrent(i1->first, i2->first)) {
-				if (LoadLoad && i1->first.thr_id == i2->first.thr_id) {
-					// Not interested if i1 and i2 are in the same thread.
-					continue;
-				}
-				for (DenseSet<DynamicInstructionWithContext>::iterator
-						j1 = i1->second.begin(); j1 != i1->second.end(); ++j1) {
-					vector<PointerAccess> accesses1 = get_pointer_accesses(j1->di.ins);
-					for (DenseSet<DynamicInstructionWithContext>::iterator
-							j2 = i2->second.begin(); j2 != i2->second.end(); ++j2) {
-						vector<PointerAccess> accesses2 = get_pointer_accesses(j2->di.ins);
-						for (size_t k1 = 0; k1 < accesses1.size(); ++k1) {
-							for (size_t k2 = 0; k2 < accesses2.size(); ++k2) {
-								if (LoadLoad || racy(accesses1[k1], accesses2[k2])) {
-									if ((++counter_for_sampling) % SampleRate != 0)
-										continue;
-									all_queries.push_back(make_pair(*j1, *j2));
-								}
-							}
-						}
-					}
-				}
-			}
-		}
+	errs() << "# of regions = " << n_regions << "\n";
+	errs() << "# of calling contexts = " << contexts.size() << "\n";
+	errs() << "# of queries = " << n_queries << "\n";
+	if (query_out) {
+		query_out = NULL;
+		delete fout;
 	}
 
-	errs() << "# of queries = " << counter_for_sampling << "\n";
-
 	// Count the number of accesses in each thread.
-	DenseMap<int, unsigned> num_of_accesses_in_threads;
-	for (DenseMap<Region, DenseSet<DynamicInstructionWithContext> >::iterator
-			i1 = sls_in_regions.begin(); i1 != sls_in_regions.end(); ++i1) {
-		num_of_accesses_in_threads[i1->first.thr_id] += i1->second.size();
-	}
 	for (DenseMap<int, unsigned>::iterator itr = num_of_accesses_in_threads.begin();
 	     itr != num_of_accesses_in_threads.end();
 	     ++itr) {
@@ -300,8 +483,10 @@ void QueryGenerator::print_dynamic_instruction_with_context(raw_ostream &O,
 		print_dynamic_instruction(O, diwc.di);
 	} else {
 		assert(Concurrent && "Not supported");
-		for (size_t i = 0; i < diwc.callstack.size(); ++i) {
-			print_dynamic_instruction(O, diwc.callstack[i]);
+		vector<DynamicInstruction> callstack;
+		contexts.get_callstack(diwc.context, callstack);
+		for (size_t i = 0; i < callstack.size(); ++i) {
+			print_dynamic_instruction(O, callstack[i]);
 			O << " ";
 		}
 		print_dynamic_instruction(O, diwc.di);
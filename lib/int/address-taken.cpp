@@ -26,6 +26,7 @@ using namespace llvm;
 #include "slicer/region-manager.h"
 #include "slicer/may-write-analyzer.h"
 #include "slicer/stratify-loads.h"
+#include "slicer/worker-pool.h"
 using namespace slicer;
 
 static cl::opt<bool> DisableAdvancedAA("disable-advanced-aa",
@@ -34,6 +35,50 @@ static cl::opt<bool> DisableAddressTaken("disable-addr-taken",
 		cl::desc("Don't capture constraints on address-taken variables"));
 static cl::opt<bool> Verbose("verbose",
 		cl::desc("Print information for each alias query"));
+static cl::opt<unsigned> CaptureJobs("capture-jobs",
+		cl::desc("# of forked workers finding the overwriters of loads"),
+		cl::init(1));
+
+// A worker needs enough loads to pay for the fork. See worker-pool.h for
+// why the workers are processes. Tests lower it to fork on small programs. 
+static cl::opt<unsigned> MinLoadsPerJob("capture-min-loads-per-job",
+		cl::desc("The fewest loads to capture for which -capture-jobs forks"),
+		cl::init(64), cl::Hidden);
+
+namespace slicer {
+	/*
+	 * Finds the valid overwriters of each load in a worker. The result is
+	 * <valid_from>, <valid_until>, whether a tentative alias answer is
+	 * used, and then the instruction IDs of the overwriters. 
+	 * The parent adds the constraints in the original order of the loads,
+	 * so the result doesn't depend on the number of workers. 
+	 */
+	struct OverwriterTask: public ListWorkerTask {
+		OverwriterTask(CaptureConstraints &c, const vector<LoadInst *> &l):
+			CC(c), loads(l) {}
+
+		virtual void run(unsigned i, vector<unsigned> &result) {
+			IDAssigner &IDA = CC.getAnalysis<IDAssigner>();
+			AdvancedAlias *AAA = CC.getAnalysisIfAvailable<AdvancedAlias>();
+			CC.start_capture_result();
+			InstList overwriters;
+			CC.find_valid_overwriters(loads[i], overwriters);
+			result.push_back(CC.capture_valid_from);
+			result.push_back(CC.capture_valid_until);
+			result.push_back(AAA && AAA->get_num_tentative_answers() !=
+					CC.capture_start_tentative_answers);
+			for (size_t k = 0; k < overwriters.size(); ++k) {
+				unsigned ins_id = IDA.getInstructionID(overwriters[k]);
+				assert(ins_id != IDAssigner::InvalidID);
+				result.push_back(ins_id);
+			}
+		}
+
+	private:
+		CaptureConstraints &CC;
+		const vector<LoadInst *> &loads;
+	};
+}
 
 Value *CaptureConstraints::get_pointer_operand(const Instruction *i) {
 	if (const StoreInst *si = dyn_cast<StoreInst>(i))
@@ -73,14 +118,28 @@ void CaptureConstraints::capture_addr_taken(Module &M) {
 }
 
 void CaptureConstraints::capture_global_vars(Module &M) {
+	unsigned n_reused = 0;
 	for (Module::global_iterator gi = M.global_begin();
 			gi != M.global_end(); ++gi) {
-		if (isa<IntegerType>(gi->getType()) || isa<PointerType>(gi->getType()))
-			capture_global_var(gi);
+		if (isa<IntegerType>(gi->getType()) || isa<PointerType>(gi->getType())) {
+			CaptureResult &r = captured_global_vars[gi];
+			if (r.captured && is_valid(r)) {
+				add_capture_result(r);
+				++n_reused;
+				continue;
+			}
+			clear_capture_result(r);
+			start_capture_result();
+			capture_global_var(gi, r.equivalent_loads);
+			finish_capture_result(r);
+			r.captured = true;
+		}
 	}
+	dbgs() << "# of reused global variables = " << n_reused << "\n";
 }
 
-void CaptureConstraints::capture_global_var(GlobalVariable *gv) {
+void CaptureConstraints::capture_global_var(GlobalVariable *gv,
+		InstList &equivalent_loads) {
 	RegionManager &RM = getAnalysis<RegionManager>();
 	MayWriteAnalyzer &MWA = getAnalysis<MayWriteAnalyzer>();
 
@@ -98,8 +157,7 @@ void CaptureConstraints::capture_global_var(GlobalVariable *gv) {
 	for (Module::iterator f = m->begin(); f != m->end(); ++f) {
 		for (Function::iterator bb = f->begin(); bb != f->end(); ++bb) {
 			for (BasicBlock::iterator ins = bb->begin(); ins != bb->end(); ++ins) {
-				ConstFuncSet visited_funcs;
-				if (MWA.may_write(ins, gv, visited_funcs, false)) {
+				if (MWA.may_write(ins, gv, false)) {
 					vector<Region> regions;
 					RM.get_containing_regions(ins, regions);
 					for (size_t i = 0; i < regions.size(); ++i) {
@@ -130,7 +188,7 @@ void CaptureConstraints::capture_global_var(GlobalVariable *gv) {
 	for (size_t i = 0; i < to_be_removed.size(); ++i)
 		overwriting_regions.erase(to_be_removed[i]);
 	
-	InstList equivalent_loads;
+	equivalent_loads.clear();
 	for (Value::use_iterator ui = gv->use_begin(); ui != gv->use_end(); ++ui) {
 		if (LoadInst *li = dyn_cast<LoadInst>(*ui)) {
 			vector<Region> containing_regions;
@@ -185,27 +243,9 @@ void CaptureConstraints::capture_global_var(GlobalVariable *gv) {
 
 void CaptureConstraints::capture_must_assign(Module &M) {
 	ExecOnce &EO = getAnalysis<ExecOnce>();
+	IDAssigner &IDA = getAnalysis<IDAssigner>();
 
-	// Compute <n_loads> in order to print the progress bar. 
-	unsigned n_loads = 0;
-	for (Module::iterator f = M.begin(); f != M.end(); ++f) {
-		if (!f->isDeclaration() && !EO.not_executed(f)) {
-			for (Function::iterator bb = f->begin(); bb != f->end(); ++bb) {
-				for (BasicBlock::iterator ins = bb->begin(); ins != bb->end(); ++ins) {
-					if (isa<LoadInst>(ins)) {
-						const Type *ty = ins->getType();
-						if (isa<IntegerType>(ty) || isa<PointerType>(ty))
-							++n_loads;
-					}
-				}
-			}
-		}
-	}
-	dbgs() << "=== Capturing must assignments === ";
-	dbgs() << "# of loads = " << n_loads << "\n";
-
-	unsigned cur_load = 0;
-	unsigned n_captured = 0, n_uncaptured = 0;
+	vector<LoadInst *> loads;
 	for (Module::iterator f = M.begin(); f != M.end(); ++f) {
 		if (f->isDeclaration())
 			continue;
@@ -216,23 +256,80 @@ void CaptureConstraints::capture_must_assign(Module &M) {
 				if (LoadInst *i2 = dyn_cast<LoadInst>(ins)) {
 					const Type *i2_type = i2->getType();
 					// We don't capture equalities on real numbers. 
-					if (isa<IntegerType>(i2_type) || isa<PointerType>(i2_type)) {
-						print_progress(dbgs(), cur_load, n_loads);
-						bool captured = capture_overwriting_to(i2);
-						++(captured ? n_captured : n_uncaptured);
-						++cur_load;
-					}
+					if (isa<IntegerType>(i2_type) || isa<PointerType>(i2_type))
+						loads.push_back(i2);
 				}
 			}
 		}
 	}
+	unsigned n_loads = loads.size();
+	dbgs() << "=== Capturing must assignments === ";
+	dbgs() << "# of loads = " << n_loads << "\n";
+
+	// Once captured, a load keeps its constraints forever. 
+	// Otherwise, reuse the previous attempt until the alias
+	// results it depends on may change. 
+	vector<LoadInst *> to_capture;
+	for (size_t i = 0; i < loads.size(); ++i) {
+		const CaptureResult &r = captured_loads[loads[i]];
+		if (!r.captured && !is_valid(r))
+			to_capture.push_back(loads[i]);
+	}
+
+	// Finding the overwriters only reads the analyses, so it can be done
+	// in workers. The constraints are added here in order. 
+	vector<vector<unsigned> > found;
+	if (CaptureJobs > 1 && to_capture.size() >= MinLoadsPerJob) {
+		OverwriterTask task(*this, to_capture);
+		run_in_workers(task, to_capture.size(), CaptureJobs, found);
+	}
+
+	unsigned n_captured = 0, n_uncaptured = 0, n_reused = 0;
+	size_t next_to_capture = 0;
+	for (unsigned cur_load = 0; cur_load < n_loads; ++cur_load) {
+		print_progress(dbgs(), cur_load, n_loads);
+		LoadInst *i2 = loads[cur_load];
+		bool captured;
+		CaptureResult &r = captured_loads[i2];
+		if (r.captured || is_valid(r)) {
+			add_capture_result(r);
+			captured = r.captured;
+			++n_reused;
+		} else {
+			assert(to_capture[next_to_capture] == i2);
+			clear_capture_result(r);
+			start_capture_result();
+			if (found.empty()) {
+				captured = capture_overwriting_to(i2);
+				finish_capture_result(r);
+			} else {
+				const vector<unsigned> &res = found[next_to_capture];
+				assert(res.size() >= 3);
+				capture_valid_from = res[0];
+				capture_valid_until = res[1];
+				InstList overwriters;
+				for (size_t k = 3; k < res.size(); ++k)
+					overwriters.push_back(IDA.getInstruction(res[k]));
+				captured = add_overwriting_constraints(i2, overwriters);
+				finish_capture_result(r);
+				// Same as <finish_capture_result>, but for the worker. 
+				if (res[2])
+					r.valid_until = 0;
+			}
+			r.captured = captured;
+			++next_to_capture;
+		}
+		++(captured ? n_captured : n_uncaptured);
+	}
+	assert(next_to_capture == to_capture.size());
 	assert(n_loads == n_captured + n_uncaptured);
 	
 	// Finish the progress bar. 
 	print_progress(dbgs(), n_loads, n_loads);
 	dbgs() << "\n";
 	dbgs() << "# of captured loads = " << n_captured
-		<< "; # of uncaptured loads = " << n_uncaptured << "\n";
+		<< "; # of uncaptured loads = " << n_uncaptured
+		<< "; # of reused loads = " << n_reused << "\n";
 }
 
 Instruction *CaptureConstraints::find_nearest_common_dom(
@@ -297,15 +394,17 @@ bool CaptureConstraints::region_may_write(const Region &r, const Value *q) {
 	if (!RM.region_has_insts(r))
 		return false;
 
-	const ConstInstList &insts_in_r = RM.get_insts_in_region(r);
 	// A region already includes exec-once functions. 
-	ConstFuncSet visited_funcs;
-	for (size_t i = 0; i < insts_in_r.size(); ++i) {
-		if (MWA.may_write(insts_in_r[i], q, visited_funcs)) {
-			DEBUG(dbgs() << "Region " << r << "may write to <q>:\n";);
-			DEBUG(dbgs() << *insts_in_r[i] << "\n";);
-			return true;
-		}
+	DenseMap<Region, unsigned>::iterator it = region_summaries.find(r);
+	if (it == region_summaries.end()) {
+		ConstInstList insts_in_r;
+		RM.get_insts_in_region(r, insts_in_r);
+		unsigned summary_id = MWA.summarize(insts_in_r);
+		it = region_summaries.insert(make_pair(r, summary_id)).first;
+	}
+	if (MWA.summary_may_write(it->second, q)) {
+		DEBUG(dbgs() << "Region " << r << "may write to <q>\n";);
+		return true;
 	}
 
 	return false;
@@ -317,22 +416,41 @@ void CaptureConstraints::add_constraints(const vector<Clause *> &cs) {
 }
 
 bool CaptureConstraints::capture_overwriting_to(LoadInst *i2) {
-	DEBUG(dbgs() << "### capture_overwriting_to:" << *i2 << "\n";);
-	DEBUG(dbgs() << "vid = " << getAnalysis<IDAssigner>().getValueID(i2) << "\n";);
+	InstList overwriters;
+	find_valid_overwriters(i2, overwriters);
+	return add_overwriting_constraints(i2, overwriters);
+}
 
-	// Check cache. 
-	if (captured_loads.count(i2)) {
-		DEBUG(dbgs() << "cache hit\n";);
-		vector<Clause *> to_be_added = captured_loads.lookup(i2);
-		for (size_t i = 0; i < to_be_added.size(); ++i) {
-			DEBUG(dbgs() << "cached constraint: ";);
-			DEBUG(print_clause(dbgs(), to_be_added[i], getAnalysis<IDAssigner>()));
-			DEBUG(dbgs() << "\n";);
-			add_constraint(to_be_added[i]->clone());
-		}
-		return true;
+bool CaptureConstraints::add_overwriting_constraints(LoadInst *i2,
+		const InstList &overwriters) {
+	vector<Clause *> final_constraints;
+	for (size_t k = 0; k < overwriters.size(); ++k) {
+		Clause *c = new Clause(new BoolExpr(
+					CmpInst::ICMP_EQ,
+					new Expr(i2),
+					new Expr(get_value_operand(overwriters[k]))));
+		final_constraints.push_back(c);
+
+		DEBUG(dbgs() << "constraint: ";);
+		DEBUG(print_clause(dbgs(), c, getAnalysis<IDAssigner>()););
+		DEBUG(dbgs() << "\n";);
 	}
 
+	DEBUG(dbgs() << "# of valid defs = " << final_constraints.size() << "\n";);
+	if (final_constraints.empty())
+		return false;
+
+	if (DisableAddressTaken)
+		final_constraints.clear();
+	add_constraints(final_constraints);
+	return true;
+}
+
+void CaptureConstraints::find_valid_overwriters(LoadInst *i2,
+		InstList &overwriters) {
+	DEBUG(dbgs() << "### capture_overwriting_to:" << *i2 << "\n";);
+	DEBUG(dbgs() << "vid = " << getAnalysis<IDAssigner>().getValueID(i2) << "\n";);
+
 	LandmarkTrace &LT = getAnalysis<LandmarkTrace>();
 	CloneInfoManager &CIM = getAnalysis<CloneInfoManager>();
 	RegionManager &RM = getAnalysis<RegionManager>();
@@ -342,14 +460,14 @@ bool CaptureConstraints::capture_overwriting_to(LoadInst *i2) {
 	// TODO: Change to is_fixed_integer? 
 	if (!EO.executed_once(i2)) {
 		DEBUG(dbgs() << "will be executed more than once. give up\n";);
-		return false;
+		return;
 	}
 	
 	vector<Region> cur_regions;
 	RM.get_containing_regions(i2, cur_regions);
 	if (cur_regions.size() != 1) {
 		DEBUG(dbgs() << "contained in multiple regions. give up\n");
-		return false;
+		return;
 	}
 	DEBUG(dbgs() << "containing region = " << cur_regions[0] << "\n";);
 
@@ -371,7 +489,7 @@ bool CaptureConstraints::capture_overwriting_to(LoadInst *i2) {
 		if (region_may_write(concurrent_regions[i], q)) {
 			DEBUG(dbgs() << concurrent_regions[i] <<
 					" may write to this pointer\n";);
-			return false;
+			return;
 		}
 	}
 
@@ -470,7 +588,6 @@ bool CaptureConstraints::capture_overwriting_to(LoadInst *i2) {
 			latest_overwriters[k1] = NULL;
 	}
 
-	vector<Clause *> final_constraints;
 	for (size_t k = 0; k < thr_ids.size(); ++k) {
 		if (!latest_overwriters[k])
 			continue; // ignore this overwriter
@@ -515,7 +632,6 @@ bool CaptureConstraints::capture_overwriting_to(LoadInst *i2) {
 			}
 		}
 		
-		// TODO: Cache the region_may_write results. 
 		bool overwritten_by_concurrent_regions = false;
 		for (DenseSet<Region>::iterator it = concurrent_regions.begin();
 				it != concurrent_regions.end(); ++it) {
@@ -528,28 +644,9 @@ bool CaptureConstraints::capture_overwriting_to(LoadInst *i2) {
 		if (overwritten_by_concurrent_regions)
 			continue; // ignore this overwriter
 
-		Clause *c = new Clause(new BoolExpr(
-					CmpInst::ICMP_EQ,
-					new Expr(i2),
-					new Expr(get_value_operand(latest_overwriters[k]))));
-		final_constraints.push_back(c);
-
+		overwriters.push_back(latest_overwriters[k]);
 		DEBUG(dbgs() << "valid def:" << *latest_overwriters[k] << "\n";);
-		DEBUG(dbgs() << "constraint: ";);
-		DEBUG(print_clause(dbgs(), c, getAnalysis<IDAssigner>()););
-		DEBUG(dbgs() << "\n";);
 	}
-
-	DEBUG(dbgs() << "# of valid defs = " << final_constraints.size() << "\n";);
-	if (final_constraints.empty())
-		return false;
-
-	if (DisableAddressTaken)
-		final_constraints.clear();
-	captured_loads[i2] = final_constraints;
-	for (size_t i = 0; i < final_constraints.size(); ++i)
-		add_constraint(final_constraints[i]->clone());
-	return true;
 }
 
 bool CaptureConstraints::path_may_write(int thr_id, size_t trunk_id,
@@ -557,6 +654,18 @@ bool CaptureConstraints::path_may_write(int thr_id, size_t trunk_id,
 	DEBUG(dbgs() << "path_may_write:" << *i2 << "\n";
 			dbgs() << thr_id << " " << trunk_id << "\n";);
 
+	MayWriteAnalyzer &MWA = getAnalysis<MayWriteAnalyzer>();
+	LandmarkPath key(make_pair(thr_id, trunk_id), i2);
+	map<LandmarkPath, unsigned>::iterator it = paths_from_landmarks.find(key);
+	if (it == paths_from_landmarks.end()) {
+		unsigned summary_id = summarize_path(thr_id, trunk_id, i2);
+		it = paths_from_landmarks.insert(make_pair(key, summary_id)).first;
+	}
+	return MWA.summary_may_write(it->second, q);
+}
+
+unsigned CaptureConstraints::summarize_path(int thr_id, size_t trunk_id,
+		const Instruction *i2) {
 	LandmarkTrace &LT = getAnalysis<LandmarkTrace>();
 	MicroBasicBlockBuilder &MBBB = getAnalysis<MicroBasicBlockBuilder>();
 	CloneInfoManager &CIM = getAnalysis<CloneInfoManager>();
@@ -593,8 +702,8 @@ bool CaptureConstraints::path_may_write(int thr_id, size_t trunk_id,
 	}
 	assert(reached_sink && "<i1> should dominate <i2>");
 
-	return mbbs_may_write(visited, landmarks,
-			InstList(1, const_cast<Instruction *>(i2)), q);
+	return summarize_mbbs(visited, landmarks,
+			InstList(1, const_cast<Instruction *>(i2)));
 }
 
 bool CaptureConstraints::path_may_write(const Instruction *i1,
@@ -602,6 +711,18 @@ bool CaptureConstraints::path_may_write(const Instruction *i1,
 	DEBUG(dbgs() << "path_may_write:" << *i1 << "\n";
 			dbgs() << thr_id << " " << trunk_id << "\n";);
 
+	MayWriteAnalyzer &MWA = getAnalysis<MayWriteAnalyzer>();
+	LandmarkPath key(make_pair(thr_id, trunk_id), i1);
+	map<LandmarkPath, unsigned>::iterator it = paths_to_landmarks.find(key);
+	if (it == paths_to_landmarks.end()) {
+		unsigned summary_id = summarize_path(i1, thr_id, trunk_id);
+		it = paths_to_landmarks.insert(make_pair(key, summary_id)).first;
+	}
+	return MWA.summary_may_write(it->second, q);
+}
+
+unsigned CaptureConstraints::summarize_path(const Instruction *i1,
+		int thr_id, size_t trunk_id) {
 	LandmarkTrace &LT = getAnalysis<LandmarkTrace>();
 	MicroBasicBlockBuilder &MBBB = getAnalysis<MicroBasicBlockBuilder>();
 	CloneInfoManager &CIM = getAnalysis<CloneInfoManager>();
@@ -638,33 +759,36 @@ bool CaptureConstraints::path_may_write(const Instruction *i1,
 	}
 	assert(reached_sink && "<i2> should post-dominate <i1>");
 
-	return mbbs_may_write(visited,
-			InstList(1, const_cast<Instruction *>(i1)),
-			landmarks, q);
+	return summarize_mbbs(visited,
+			InstList(1, const_cast<Instruction *>(i1)), landmarks);
 }
 
-bool CaptureConstraints::mbbs_may_write(const DenseSet<const ICFGNode *> &mbbs,
-		const InstList &starts, const InstList &ends, const Value *q) {
+unsigned CaptureConstraints::summarize_mbbs(
+		const DenseSet<const ICFGNode *> &mbbs,
+		const InstList &starts, const InstList &ends) {
+	MayWriteAnalyzer &MWA = getAnalysis<MayWriteAnalyzer>();
+
+	ConstInstSet start_set(starts.begin(), starts.end());
+	ConstInstSet end_set(ends.begin(), ends.end());
+	ConstInstList insts;
 	for (DenseSet<const ICFGNode *>::const_iterator it = mbbs.begin();
 			it != mbbs.end(); ++it) {
 		const MicroBasicBlock *mbb = (*it)->getMBB();
-		if (mbb_may_write(mbb, starts, ends, q))
-			return true;
+		get_insts_in_mbb(mbb, start_set, end_set, insts);
 	}
-
-	return false;
+	// Trace into functions that don't appear in the ICFG. 
+	return MWA.summarize(insts);
 }
 
-bool CaptureConstraints::mbb_may_write(const MicroBasicBlock *mbb,
-		const InstList &starts, const InstList &ends, const Value *q) {
-	MayWriteAnalyzer &MWA = getAnalysis<MayWriteAnalyzer>();
-
+void CaptureConstraints::get_insts_in_mbb(const MicroBasicBlock *mbb,
+		const ConstInstSet &starts, const ConstInstSet &ends,
+		ConstInstList &insts) {
 	// The starting point may not be the entry of <mbb>. It may be one of the
 	// instructions in <starts>. 
 	BasicBlock::const_iterator s = mbb->end();
 	while (s != mbb->begin()) {
 		--s;
-		if (find(starts.begin(), starts.end(), s) != starts.end()) {
+		if (starts.count(s)) {
 			++s;
 			break;
 		}
@@ -674,19 +798,13 @@ bool CaptureConstraints::mbb_may_write(const MicroBasicBlock *mbb,
 	// instructions in <ends>. 
 	BasicBlock::const_iterator e = mbb->begin();
 	while (e != mbb->end()) {
-		if (find(ends.begin(), ends.end(), e) != ends.end())
+		if (ends.count(e))
 			break;
 		++e;
 	}
 
-	// Trace into functions that don't appear in the ICFG. 
-	ConstFuncSet visited_funcs;
-	for (BasicBlock::const_iterator i = s; i != e; ++i) {
-		if (MWA.may_write(i, q, visited_funcs))
-			return true;
-	}
- 	
-	return false;
+	for (BasicBlock::const_iterator i = s; i != e; ++i)
+		insts.push_back(i);
 }
 
 bool CaptureConstraints::path_may_write(const Instruction *i1,
@@ -699,6 +817,19 @@ bool CaptureConstraints::path_may_write(const Instruction *i1,
 	DEBUG(dbgs() << "[" << i2->getParent()->getParent()->getName() << "]";);
 	DEBUG(dbgs() << *i2 << "\n";);
 
+	MayWriteAnalyzer &MWA = getAnalysis<MayWriteAnalyzer>();
+	pair<const Instruction *, const Instruction *> key(i1, i2);
+	DenseMap<pair<const Instruction *, const Instruction *>,
+		unsigned>::iterator it = paths.find(key);
+	if (it == paths.end()) {
+		unsigned summary_id = summarize_path(i1, i2);
+		it = paths.insert(make_pair(key, summary_id)).first;
+	}
+	return MWA.summary_may_write(it->second, q);
+}
+
+unsigned CaptureConstraints::summarize_path(const Instruction *i1,
+		const Instruction *i2) {
 	MicroBasicBlockBuilder &MBBB = getAnalysis<MicroBasicBlockBuilder>();
 	MicroBasicBlock *m1 = MBBB.parent(i1), *m2 = MBBB.parent(i2);
 
@@ -712,9 +843,9 @@ bool CaptureConstraints::path_may_write(const Instruction *i1,
 	IR.floodfill_r(n2, sink, visited);
 	assert(visited.count(n1) && "<i1> should dominate <i2>");
 
-	return mbbs_may_write(visited,
+	return summarize_mbbs(visited,
 			InstList(1, const_cast<Instruction *>(i1)),
-			InstList(1, const_cast<Instruction *>(i2)), q);
+			InstList(1, const_cast<Instruction *>(i2)));
 }
 
 BasicBlock *CaptureConstraints::get_idom(BasicBlock *bb) {
@@ -773,11 +904,16 @@ bool CaptureConstraints::may_alias(const Value *v1, const Value *v2) {
 
 	unsigned l1 = SL.get_level(v1), l2 = SL.get_level(v2);
 	if (!DisableAdvancedAA && AAA && l1 <= current_level && l2 <= current_level) {
+		// The result holds only at or above this level. 
+		capture_valid_from = max(capture_valid_from, max(l1, l2));
 		bool res = AAA->may_alias(v1, v2);
 		if (Verbose)
 			dbgs() << (res ? "A" : "a");
 		return res;
 	} else {
+		// AAA will be used once the level reaches max(l1, l2). 
+		if (!DisableAdvancedAA && AAA)
+			capture_valid_until = min(capture_valid_until, max(l1, l2));
 		AliasAnalysis &BAA = getAnalysis<AliasAnalysis>();
 		return BAA.alias(v1, 0, v2, 0) == AliasAnalysis::MayAlias;
 	}
@@ -789,11 +925,14 @@ bool CaptureConstraints::must_alias(const Value *v1, const Value *v2) {
 
 	unsigned l1 = SL.get_level(v1), l2 = SL.get_level(v2);
 	if (!DisableAdvancedAA && AAA && l1 <= current_level && l2 <= current_level) {
+		capture_valid_from = max(capture_valid_from, max(l1, l2));
 		bool res = AAA->must_alias(v1, v2);
 		if (Verbose)
 			dbgs() << (res ? "U" : "u");
 		return res;
 	} else {
+		if (!DisableAdvancedAA && AAA)
+			capture_valid_until = min(capture_valid_until, max(l1, l2));
 		return v1 == v2;
 	}
 }
@@ -28,9 +28,10 @@ void AdvancedAlias::getAnalysisUsage(AnalysisUsage &AU) const {
 	AU.addRequiredTransitive<IDAssigner>();
 	AU.addRequiredTransitive<AliasAnalysis>();
 	AU.addRequiredTransitive<SolveConstraints>();
+	AU.addRequiredTransitive<CaptureConstraints>();
 }
 
-AdvancedAlias::AdvancedAlias(): ModulePass(ID) {
+AdvancedAlias::AdvancedAlias(): ModulePass(ID), num_tentative_answers(0) {
 }
 
 char AdvancedAlias::ID = 0;
@@ -128,8 +129,11 @@ bool AdvancedAlias::must_alias(const Use *u1, const Use *u2) {
 			return true;
 	}
 	
-	return SC.provable(CmpInst::ICMP_EQ,
+	pro = SC.provable(CmpInst::ICMP_EQ,
 			ConstInstList(), u1, ConstInstList(), u2);
+	if (!pro)
+		++num_tentative_answers;
+	return pro;
 }
 
 bool AdvancedAlias::must_alias(const Value *v1, const Value *v2) {
@@ -150,6 +154,8 @@ bool AdvancedAlias::must_alias(const Value *v1, const Value *v2) {
 					clock() - start, QueryInfo(false, v1, v2, pro)));
 		add_to_must_cache(v1, v2, pro);
 	}
+	if (!pro)
+		++num_tentative_answers;
 	return pro;
 }
 
@@ -167,8 +173,11 @@ bool AdvancedAlias::may_alias(const Use *u1, const Use *u2) {
 			return false;
 	}
 
-	return SC.satisfiable(CmpInst::ICMP_EQ,
+	sat = SC.satisfiable(CmpInst::ICMP_EQ,
 			ConstInstList(), u1, ConstInstList(), u2);
+	if (sat)
+		++num_tentative_answers;
+	return sat;
 }
 
 bool AdvancedAlias::may_alias(const Value *v1, const Value *v2) {
@@ -189,6 +198,8 @@ bool AdvancedAlias::may_alias(const Value *v1, const Value *v2) {
 					clock() - start, QueryInfo(true, v1, v2, sat)));
 		add_to_may_cache(v1, v2, sat);
 	}
+	if (sat)
+		++num_tentative_answers;
 	return sat;
 }
 
@@ -209,6 +220,81 @@ AliasAnalysis::AliasResult AdvancedAlias::alias(
 	return MayAlias;
 }
 
+void AdvancedAlias::alias(const vector<AliasQuery> &queries,
+		vector<AliasResult> &results) {
+	CaptureConstraints &CC = getAnalysis<CaptureConstraints>();
+	SolveConstraints &SC = getAnalysis<SolveConstraints>();
+
+	results.assign(queries.size(), NoAlias);
+
+	// Queries that need the solver. 
+	vector<unsigned> todo;
+	vector<const Clause *> clauses;
+	for (size_t i = 0; i < queries.size(); ++i) {
+		const AliasQuery &q = queries[i];
+		// Context-insensitive version is much faster. 
+		if (AliasAnalysis::alias(q.v1, 0, q.v2, 0) == NoAlias)
+			continue;
+		// Cached results are context-insensitive. A not-may or must result
+		// holds in any context as well. 
+		bool res;
+		if (check_may_cache(q.v1, q.v2, res) && !res)
+			continue;
+		if (check_must_cache(q.v1, q.v2, res) && res) {
+			results[i] = MustAlias;
+			continue;
+		}
+		Expr *e1 = new Expr(q.v1), *e2 = new Expr(q.v2);
+		CC.attach_context(e1, 1);
+		CC.attach_context(e2, 2);
+		e1->callstack = q.c1;
+		e2->callstack = q.c2;
+		todo.push_back(i);
+		clauses.push_back(new Clause(new BoolExpr(CmpInst::ICMP_EQ, e1, e2)));
+	}
+
+	vector<bool> sat;
+	SC.satisfiable(clauses, sat);
+	// Only satisfiable queries need the must-alias check. 
+	vector<unsigned> todo_must;
+	vector<const Clause *> clauses_must;
+	for (size_t j = 0; j < todo.size(); ++j) {
+		if (sat[j]) {
+			todo_must.push_back(todo[j]);
+			clauses_must.push_back(clauses[j]);
+		}
+	}
+	vector<bool> pro;
+	SC.provable(clauses_must, pro);
+
+	for (size_t j = 0; j < todo.size(); ++j) {
+		if (sat[j])
+			results[todo[j]] = MayAlias;
+	}
+	for (size_t j = 0; j < todo_must.size(); ++j) {
+		if (pro[j])
+			results[todo_must[j]] = MustAlias;
+	}
+	// Neither disproved nor proved. 
+	for (size_t j = 0; j < todo.size(); ++j) {
+		if (results[todo[j]] == MayAlias)
+			++num_tentative_answers;
+	}
+	// Context-free results can be cached. 
+	for (size_t j = 0; j < todo.size(); ++j) {
+		const AliasQuery &q = queries[todo[j]];
+		if (q.c1.empty() && q.c2.empty()) {
+			if (!sat[j])
+				add_to_may_cache(q.v1, q.v2, false);
+			else
+				add_to_must_cache(q.v1, q.v2, results[todo[j]] == MustAlias);
+		}
+	}
+
+	for (size_t j = 0; j < clauses.size(); ++j)
+		delete clauses[j];
+}
+
 AliasAnalysis::AliasResult AdvancedAlias::alias(
 		const Location &L1, const Location &L2) {
 	const Value *v1 = L1.Ptr, *v2 = L2.Ptr;
@@ -0,0 +1,91 @@
+/**
+ * Author: Jingyue
+ */
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+using namespace std;
+
+#include "slicer/query-cache.h"
+using namespace slicer;
+
+bool QueryCache::lookup(const string &key, bool &res) const {
+	StringMap<bool>::const_iterator it = results.find(key);
+	if (it == results.end())
+		return false;
+	res = it->getValue();
+	return true;
+}
+
+void QueryCache::insert(const string &key, bool res) {
+	if (results.count(key))
+		return;
+	results[key] = res;
+	modified = true;
+}
+
+void QueryCache::clear() {
+	results.clear();
+	modified = false;
+}
+
+/*
+ * File format: one entry per line.
+ * <0 or 1> <key>
+ */
+void QueryCache::read_entries(istream &in, StringMap<bool> &entries) {
+	string line;
+	while (getline(in, line)) {
+		if (line.length() < 3 || line[1] != ' ')
+			continue;
+		entries[line.substr(2)] = (line[0] == '1');
+	}
+}
+
+bool QueryCache::load(const string &file_name) {
+	ifstream fin(file_name.c_str());
+	if (!fin)
+		return false;
+	read_entries(fin, results);
+	modified = false;
+	return true;
+}
+
+bool QueryCache::save(const string &file_name, const string &prefix) {
+	if (!modified)
+		return true;
+
+	// Keep the entries other runs saved after our <load>. 
+	StringMap<bool> merged;
+	ifstream fin(file_name.c_str());
+	if (fin)
+		read_entries(fin, merged);
+	fin.close();
+	for (StringMap<bool>::const_iterator it = results.begin();
+			it != results.end(); ++it)
+		merged[it->getKey()] = it->getValue();
+
+	ostringstream tmp_oss;
+	tmp_oss << file_name << ".tmp." << getpid();
+	string tmp_file_name = tmp_oss.str();
+	ofstream fout(tmp_file_name.c_str());
+	if (!fout)
+		return false;
+	for (StringMap<bool>::const_iterator it = merged.begin();
+			it != merged.end(); ++it) {
+		if (it->getKey().startswith(prefix)) {
+			fout << (it->getValue() ? '1' : '0') << ' ' <<
+				it->getKey().str() << "\n";
+		}
+	}
+	fout.close();
+	if (!fout || rename(tmp_file_name.c_str(), file_name.c_str()) != 0) {
+		remove(tmp_file_name.c_str());
+		return false;
+	}
+	modified = false;
+	return true;
+}
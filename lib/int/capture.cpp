@@ -33,8 +33,15 @@ using namespace std;
 #include "slicer/region-manager.h"
 #include "slicer/may-write-analyzer.h"
 #include "slicer/stratify-loads.h"
+#include "slicer/adv-alias.h"
+#include "slicer/analysis-cache.h"
 using namespace slicer;
 
+static bool compare_first_printed(const pair<string, Clause *> &a,
+		const pair<string, Clause *> &b) {
+	return CompareClause::compare_printed(a.first, b.first);
+}
+
 void CaptureConstraints::getAnalysisUsage(AnalysisUsage &AU) const {
 	// LLVM 2.9 crashes if I addRequiredTransitive FunctionPasses.
 	AU.setPreservesAll();
@@ -64,12 +71,23 @@ STATISTIC(num_pointers, "Number of pointers");
 char CaptureConstraints::ID = 0;
 
 CaptureConstraints::CaptureConstraints():
-	ModulePass(ID), IDT(false), current_level((unsigned)-1)
+	ModulePass(ID), fingerprint(0), static_captured(false),
+	module_hash(0), module_hashed(false),
+	IDT(false), current_level((unsigned)-1)
 {
 }
 
 CaptureConstraints::~CaptureConstraints() {
 	clear_constraints();
+	for (size_t i = 0; i < static_constraints.size(); ++i)
+		delete static_constraints[i];
+	for (DenseMap<LoadInst *, CaptureResult>::iterator
+			it = captured_loads.begin(); it != captured_loads.end(); ++it)
+		clear_capture_result(it->second);
+	for (DenseMap<GlobalVariable *, CaptureResult>::iterator
+			it = captured_global_vars.begin();
+			it != captured_global_vars.end(); ++it)
+		clear_capture_result(it->second);
 }
 
 void CaptureConstraints::print(raw_ostream &O, const Module *M) const {
@@ -160,47 +178,186 @@ void CaptureConstraints::clear_constraints() {
 		*it = NULL;
 	}
 	constraints.clear();
+	constraint_keys.clear();
+	fingerprint = 0;
 }
 
 void CaptureConstraints::calculate(Module &M) {
 	clear_constraints();
 
-	// Check whether each loop is in the simplified and LCSSA form. 
-	check_loops(M);
-
 	// Identify all integer and pointer variables. 
 	identify_fixed_integers(M);
 	// <fixed_integers> may be changed in <capture_addr_taken>. 
 
-	// Look at arithmetic operations on these constants. 
-	capture_top_level(M);
+	// Constraints that don't depend on alias results. 
+	capture_static(M);
 	// Look at loads and stores. 
-	// The algorithm to capture address-taken variables are flow-sensitive.
-	// Need compute the inter-procedural CFG before hand. 
-	ICFG &PIB = getAnalysis<PartialICFGBuilder>();
-	IDT.recalculate<ICFG>(PIB);
 	capture_addr_taken(M);
-	// Collect constraints from unreachable blocks. 
-	capture_unreachable(M);
-	// Function summaries.
-	// TODO: We'd better have a generic module for all function summaries
-	// instead of writing it for each project. 
-	capture_function_summaries(M);
 
 	simplify_constraints();
 	dbgs() << "# of constraints = " << get_num_constraints() << "\n";
 	if (DisableAllConstraints)
-		constraints.clear();
+		clear_constraints();
+}
+
+void CaptureConstraints::capture_static(Module &M) {
+	if (static_captured) {
+		for (size_t i = 0; i < static_constraints.size(); ++i)
+			add_constraint(static_constraints[i]->clone(), static_keys[i]);
+		return;
+	}
+
+	size_t start = constraints.size();
+	// The static constraints depend on nothing but the module, so they can
+	// be reused by later runs on the same bitcode. 
+	string cache_file;
+	if (AnalysisCache::enabled())
+		cache_file = AnalysisCache::get_file_name(get_module_hash(M),
+				"capture-static", "");
+	if (cache_file == "" || !load_static_constraints(M, cache_file)) {
+		// Check whether each loop is in the simplified and LCSSA form. 
+		check_loops(M);
+		// Look at arithmetic operations on these constants. 
+		capture_top_level(M);
+		// Collect constraints from unreachable blocks. 
+		capture_unreachable(M);
+		// Function summaries.
+		// TODO: We'd better have a generic module for all function summaries
+		// instead of writing it for each project. 
+		capture_function_summaries(M);
+		if (cache_file != "")
+			save_static_constraints(start, cache_file);
+	}
+	for (size_t i = start; i < constraints.size(); ++i) {
+		static_constraints.push_back(constraints[i]->clone());
+		static_keys.push_back(constraint_keys[i]);
+	}
+
+	// The algorithm to capture address-taken variables are flow-sensitive.
+	// Need compute the inter-procedural CFG before hand. 
+	ICFG &PIB = getAnalysis<PartialICFGBuilder>();
+	IDT.recalculate<ICFG>(PIB);
+
+	static_captured = true;
+}
+
+bool CaptureConstraints::load_static_constraints(Module &M,
+		const string &file_name) {
+	vector<unsigned> data;
+	if (!AnalysisCache::load(file_name, data) || data.empty())
+		return false;
+	IDAssigner &IDA = getAnalysis<IDAssigner>();
+	size_t pos = 0;
+	unsigned n_constraints = data[pos++];
+	// Add nothing unless the whole file decodes, so that the caller can
+	// fall back to capturing the constraints again. 
+	vector<Clause *> decoded;
+	bool ok = true;
+	for (unsigned i = 0; i < n_constraints && ok; ++i) {
+		Clause *c = decode_clause(data, pos, IDA, M.getContext());
+		if (c)
+			decoded.push_back(c);
+		else
+			ok = false;
+	}
+	if (!ok || pos != data.size()) {
+		for (size_t i = 0; i < decoded.size(); ++i)
+			delete decoded[i];
+		errs() << "[Warning] Ignoring the malformed static constraints in " <<
+			file_name << "\n";
+		return false;
+	}
+	for (size_t i = 0; i < decoded.size(); ++i)
+		add_constraint(decoded[i]);
+	dbgs() << "Loaded " << n_constraints << " static constraints from " <<
+		file_name << "\n";
+	return true;
+}
+
+void CaptureConstraints::save_static_constraints(size_t start,
+		const string &file_name) {
+	IDAssigner &IDA = getAnalysis<IDAssigner>();
+	vector<unsigned> data;
+	data.push_back(constraints.size() - start);
+	for (size_t i = start; i < constraints.size(); ++i) {
+		if (!encode_clause(constraints[i], IDA, data)) {
+			// Some value has no ID, so the constraints can't be persisted. 
+			return;
+		}
+	}
+	if (!AnalysisCache::save(file_name, data))
+		errs() << "[Warning] Cannot save the static constraints\n";
+}
+
+void CaptureConstraints::start_capture_result() {
+	capture_start = constraints.size();
+	AdvancedAlias *AAA = getAnalysisIfAvailable<AdvancedAlias>();
+	capture_start_tentative_answers = (AAA ?
+			AAA->get_num_tentative_answers() : 0);
+	capture_valid_from = 0;
+	capture_valid_until = (unsigned)-1;
+}
+
+void CaptureConstraints::finish_capture_result(CaptureResult &r) {
+	AdvancedAlias *AAA = getAnalysisIfAvailable<AdvancedAlias>();
+	r.used_advanced_alias = (AAA != NULL);
+	r.valid_from = capture_valid_from;
+	r.valid_until = capture_valid_until;
+	// Tentative answers may change once AAA recalculates. 
+	if (AAA && AAA->get_num_tentative_answers() != capture_start_tentative_answers)
+		r.valid_until = 0;
+	for (size_t i = capture_start; i < constraints.size(); ++i) {
+		r.constraints.push_back(constraints[i]->clone());
+		r.keys.push_back(constraint_keys[i]);
+	}
+}
+
+bool CaptureConstraints::is_valid(const CaptureResult &r) {
+	if (is_using_advanced_alias() != r.used_advanced_alias)
+		return false;
+	return r.valid_from <= current_level && current_level < r.valid_until;
+}
+
+void CaptureConstraints::add_capture_result(const CaptureResult &r) {
+	for (size_t i = 0; i < r.constraints.size(); ++i)
+		add_constraint(r.constraints[i]->clone(), r.keys[i]);
+	for (size_t i = 0; i < r.equivalent_loads.size(); ++i)
+		fixed_integers.insert(r.equivalent_loads[i]);
+}
+
+void CaptureConstraints::clear_capture_result(CaptureResult &r) {
+	for (size_t i = 0; i < r.constraints.size(); ++i)
+		delete r.constraints[i];
+	r = CaptureResult();
 }
 
 void CaptureConstraints::simplify_constraints() {
 	/*
 	 * Sort constraints.
-	 * so that get_fingerprint will return the same value deterministically
+	 * so that the solver sees the same constraints in the same order
 	 * for the same set of constraints. 
+	 * Compare the printed forms which are computed only once. 
 	 */
-	sort(constraints.begin(), constraints.end(),
-			CompareClause(getAnalysis<IDAssigner>()));
+	vector<pair<string, Clause *> > sorted;
+	for (size_t i = 0; i < constraints.size(); ++i)
+		sorted.push_back(make_pair(constraint_keys[i], constraints[i]));
+	sort(sorted.begin(), sorted.end(), compare_first_printed);
+	for (size_t i = 0; i < sorted.size(); ++i) {
+		constraint_keys[i] = sorted[i].first;
+		constraints[i] = sorted[i].second;
+	}
+
+	// Combine the hashes of the sorted keys. Unlike a sum, it's sensitive
+	// to which keys appear, not only to the total of their hashes. 
+	locale loc;
+	const collate<char> &coll = use_facet<collate<char> >(loc);
+	unsigned long res = constraint_keys.size();
+	for (size_t i = 0; i < constraint_keys.size(); ++i) {
+		const string &key = constraint_keys[i];
+		unsigned long h = coll.hash(key.data(), key.data() + key.length());
+		res ^= h + 0x9e3779b9 + (res << 6) + (res >> 2);
+	}
+	fingerprint = (long)res;
 }
 
 unsigned CaptureConstraints::get_num_constraints() const {
@@ -209,17 +366,15 @@ unsigned CaptureConstraints::get_num_constraints() const {
 }
 
 long CaptureConstraints::get_fingerprint() const {
-	long res = 0;
-	IDAssigner &IDA = getAnalysis<IDAssigner>();
-	locale loc;
-	const collate<char> &coll = use_facet<collate<char> >(loc);
-	for (size_t i = 0; i < constraints.size(); ++i) {
-		string str;
-		raw_string_ostream oss(str);
-		print_clause(oss, constraints[i], IDA);
-		res += coll.hash(oss.str().data(), oss.str().data() + oss.str().length());
+	return fingerprint;
+}
+
+long CaptureConstraints::get_module_hash(const Module &M) {
+	if (!module_hashed) {
+		module_hash = AnalysisCache::hash_module(M);
+		module_hashed = true;
 	}
-	return res;
+	return module_hash;
 }
 
 bool CaptureConstraints::print_progress(
@@ -240,6 +395,17 @@ bool CaptureConstraints::print_progress(
 void CaptureConstraints::add_constraint(Clause *c) {
 	// TODO: Simplify the clause. 
 	// e.g. Split the conjuction. 
-	if (c)
-		constraints.push_back(c);
+	if (c) {
+		string key;
+		raw_string_ostream oss(key);
+		print_clause(oss, c, getAnalysis<IDAssigner>());
+		oss.flush();
+		add_constraint(c, key);
+	}
+}
+
+void CaptureConstraints::add_constraint(Clause *c, const string &key) {
+	assert(c);
+	constraints.push_back(c);
+	constraint_keys.push_back(key);
 }
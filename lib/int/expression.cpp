@@ -2,6 +2,8 @@
  * Author: Jingyue
  */
 
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/RecyclingAllocator.h"
 #include "rcs/util.h"
 using namespace llvm;
 
@@ -9,6 +11,20 @@ using namespace llvm;
 #include "slicer/capture.h"
 using namespace slicer;
 
+/*
+ * Freed nodes are recycled for later nodes of the same type. 
+ * The pools are leaked on purpose. Passes release their clauses in their
+ * destructors, which may run after the static destructors of this file,
+ * e.g. when the PassManager is destroyed at exit. A leaked pool outlives
+ * every node. 
+ */
+template <typename T>
+static RecyclingAllocator<BumpPtrAllocator, T> &get_allocator() {
+	static RecyclingAllocator<BumpPtrAllocator, T> *allocator =
+		new RecyclingAllocator<BumpPtrAllocator, T>();
+	return *allocator;
+}
+
 bool CompareClause::operator()(const Clause *a, const Clause *b) {
 	string str_a, str_b;
 	raw_string_ostream oss_a(str_a), oss_b(str_b);
@@ -16,7 +32,10 @@ bool CompareClause::operator()(const Clause *a, const Clause *b) {
 	print_clause(oss_b, b, IDA);
 	oss_a.flush();
 	oss_b.flush();
+	return compare_printed(str_a, str_b);
+}
 
+bool CompareClause::compare_printed(const string &str_a, const string &str_b) {
 	unsigned n_brackets_a = 0, n_brackets_b = 0;
 	for (size_t i = 0; i < str_a.length(); ++i)
 		n_brackets_a += (str_a[i] == '(' || str_a[i] == ')');
@@ -35,25 +54,55 @@ Expr *Expr::clone() const {
 		res->callstack = this->callstack;
 		return res;
 	}
-	if (type == Unary)
-		return new Expr(op, e1->clone());
-	if (type == Binary)
-		return new Expr(op, e1->clone(), e2->clone());
+	if (type == Unary) {
+		++e1->n_refs;
+		return new Expr(op, e1);
+	}
+	if (type == Binary) {
+		++e1->n_refs;
+		++e2->n_refs;
+		return new Expr(op, e1, e2);
+	}
 	errs() << "type = " << type << "\n";
 	assert_unreachable();
 }
 
+void Expr::release() const {
+	assert(n_refs > 0);
+	--n_refs;
+	if (n_refs == 0)
+		delete this;
+}
+
+Expr *Expr::unshare() {
+	if (n_refs == 1)
+		return this;
+	Expr *res = clone();
+	release();
+	return res;
+}
+
 Expr::~Expr() {
+	assert(n_refs <= 1 && "Deleting a shared Expr");
 	if (e1) {
-		delete e1;
+		e1->release();
 		e1 = NULL;
 	}
 	if (e2) {
-		delete e2;
+		e2->release();
 		e2 = NULL;
 	}
 }
 
+void *Expr::operator new(size_t size) {
+	assert(size == sizeof(Expr));
+	return get_allocator<Expr>().Allocate();
+}
+
+void Expr::operator delete(void *p) {
+	get_allocator<Expr>().Deallocate((Expr *)p);
+}
+
 unsigned Expr::get_width() const {
 	if (type == SingleDef || type == LoopBound || type == SingleUse) {
 		const Value *val = (type == SingleUse ? u->get(): v);
@@ -73,6 +122,7 @@ unsigned Expr::get_width() const {
 }
 
 Expr::Expr(const Use *use, unsigned c) {
+	n_refs = 1;
 	type = SingleUse;
 	e1 = e2 = NULL;
 	context = c;
@@ -81,6 +131,7 @@ Expr::Expr(const Use *use, unsigned c) {
 
 // <t> can be LoopBound as well, although seldom used. 
 Expr::Expr(const Value *value, unsigned c, enum Type t) {
+	n_refs = 1;
 	type = t;
 	e1 = e2 = NULL;
 	v = value;
@@ -88,6 +139,7 @@ Expr::Expr(const Value *value, unsigned c, enum Type t) {
 }
 
 Expr::Expr(unsigned opcode, Expr *expr) {
+	n_refs = 1;
 	type = Unary;
 	op = opcode;
 	e1 = expr;
@@ -98,6 +150,7 @@ Expr::Expr(unsigned opcode, Expr *expr) {
 }
 
 Expr::Expr(unsigned opcode, Expr *expr1, Expr *expr2) {
+	n_refs = 1;
 	type = Binary;
 	op = opcode;
 	e1 = expr1;
@@ -124,10 +177,37 @@ Expr::Expr(unsigned opcode, Expr *expr1, Expr *expr2) {
 }
 
 BoolExpr *BoolExpr::clone() const {
-	return new BoolExpr(p, e1->clone(), e2->clone());
+	++e1->n_refs;
+	++e2->n_refs;
+	return new BoolExpr(p, e1, e2);
+}
+
+void BoolExpr::release() const {
+	assert(n_refs > 0);
+	--n_refs;
+	if (n_refs == 0)
+		delete this;
+}
+
+BoolExpr *BoolExpr::unshare() {
+	if (n_refs == 1)
+		return this;
+	BoolExpr *res = clone();
+	release();
+	return res;
+}
+
+void *BoolExpr::operator new(size_t size) {
+	assert(size == sizeof(BoolExpr));
+	return get_allocator<BoolExpr>().Allocate();
+}
+
+void BoolExpr::operator delete(void *p) {
+	get_allocator<BoolExpr>().Deallocate((BoolExpr *)p);
 }
 
 BoolExpr::BoolExpr(CmpInst::Predicate pred, Expr *expr1, Expr *expr2) {
+	n_refs = 1;
 	p = pred;
 	e1 = expr1;
 	e2 = expr2;
@@ -148,21 +228,52 @@ BoolExpr::BoolExpr(CmpInst::Predicate pred, Expr *expr1, Expr *expr2) {
 }
 
 BoolExpr::~BoolExpr() {
-	delete e1;
-	delete e2;
+	assert(n_refs <= 1 && "Deleting a shared BoolExpr");
+	e1->release();
+	e2->release();
 	e1 = e2 = NULL;
 }
 
 Clause *Clause::clone() const {
-	if (be)
-		return new Clause(be->clone());
-	else if (op == Instruction::UserOp1)
-		return new Clause(op, c1->clone());
-	else
-		return new Clause(op, c1->clone(), c2->clone());
+	if (be) {
+		++be->n_refs;
+		return new Clause(be);
+	} else if (op == Instruction::UserOp1) {
+		++c1->n_refs;
+		return new Clause(op, c1);
+	} else {
+		++c1->n_refs;
+		++c2->n_refs;
+		return new Clause(op, c1, c2);
+	}
+}
+
+void Clause::release() const {
+	assert(n_refs > 0);
+	--n_refs;
+	if (n_refs == 0)
+		delete this;
+}
+
+Clause *Clause::unshare() {
+	if (n_refs == 1)
+		return this;
+	Clause *res = clone();
+	release();
+	return res;
+}
+
+void *Clause::operator new(size_t size) {
+	assert(size == sizeof(Clause));
+	return get_allocator<Clause>().Allocate();
+}
+
+void Clause::operator delete(void *p) {
+	get_allocator<Clause>().Deallocate((Clause *)p);
 }
 
 Clause::Clause(unsigned opcode, Clause *lhs, Clause *rhs) {
+	n_refs = 1;
 	op = opcode;
 	be = NULL;
 	c1 = lhs;
@@ -173,6 +284,7 @@ Clause::Clause(unsigned opcode, Clause *lhs, Clause *rhs) {
 }
 
 Clause::Clause(unsigned opcode, Clause *child) {
+	n_refs = 1;
 	op = opcode;
 	be = NULL;
 	c1 = child;
@@ -182,18 +294,24 @@ Clause::Clause(unsigned opcode, Clause *child) {
 }
 
 Clause::Clause(BoolExpr *expr) {
+	n_refs = 1;
 	op = 0;
 	be = expr;
 	c1 = c2 = NULL;
 }
 
 Clause::~Clause() {
+	assert(n_refs <= 1 && "Deleting a shared Clause");
+	if (be) {
+		be->release();
+		be = NULL;
+	}
 	if (c1) {
-		delete c1;
+		c1->release();
 		c1 = NULL;
 	}
 	if (c2) {
-		delete c2;
+		c2->release();
 		c2 = NULL;
 	}
 }
@@ -358,6 +476,251 @@ void slicer::print_clause(raw_ostream &O, const Clause *c, IDAssigner &IDA) {
 	O << ")";
 }
 
+/*
+ * Encoding:
+ * Clause:   0 <predicate> <Expr> <Expr> if it's a BoolExpr,
+ *           <op> <Clause> if it's a NOT, and
+ *           <op> <Clause> <Clause> otherwise.
+ * Expr:     <type> <context> <leaf> <# of callstack> <ins IDs...> for
+ *           SingleDefs and LoopBounds,
+ *           <type> <context> <user value ID> <operand #> <# of callstack>
+ *           <ins IDs...> for SingleUses,
+ *           <type> <op> <Expr> for Unarys, and
+ *           <type> <op> <Expr> <Expr> for Binarys.
+ * leaf:     0 <value ID> or 1 <bit width> <low 32 bits> <high 32 bits>
+ *           for ConstantInts.
+ */
+enum { LeafValue, LeafConstantInt };
+
+static bool encode_value(const Value *v, IDAssigner &IDA,
+		vector<unsigned> &data) {
+	// Some ConstantInts are generated by our constraint capturer, so they
+	// may not have IDs. 
+	if (const ConstantInt *ci = dyn_cast<ConstantInt>(v)) {
+		unsigned bit_width = ci->getType()->getBitWidth();
+		if (bit_width > 64)
+			return false;
+		uint64_t x = ci->getZExtValue();
+		data.push_back(LeafConstantInt);
+		data.push_back(bit_width);
+		data.push_back((unsigned)x);
+		data.push_back((unsigned)(x >> 32));
+		return true;
+	}
+	unsigned value_id = IDA.getValueID(v);
+	if (value_id == IDAssigner::InvalidID)
+		return false;
+	data.push_back(LeafValue);
+	data.push_back(value_id);
+	return true;
+}
+
+/*
+ * The decoders below return NULL on malformed data instead of asserting,
+ * because the data comes from a file that may be truncated, corrupted, or
+ * written for another bitcode. 
+ */
+static const Value *decode_value(const vector<unsigned> &data, size_t &pos,
+		IDAssigner &IDA, LLVMContext &C) {
+	if (pos >= data.size())
+		return NULL;
+	if (data[pos] == LeafConstantInt) {
+		if (pos + 4 > data.size())
+			return NULL;
+		unsigned bit_width = data[pos + 1];
+		if (bit_width == 0 || bit_width > 64)
+			return NULL;
+		uint64_t x = ((uint64_t)data[pos + 3] << 32) | data[pos + 2];
+		pos += 4;
+		return ConstantInt::get(IntegerType::get(C, bit_width), x);
+	}
+	if (data[pos] != LeafValue || pos + 2 > data.size())
+		return NULL;
+	const Value *v = IDA.getValue(data[pos + 1]);
+	pos += 2;
+	return v;
+}
+
+static bool encode_expr(const Expr *e, IDAssigner &IDA,
+		vector<unsigned> &data) {
+	data.push_back(e->type);
+	if (e->type == Expr::SingleDef || e->type == Expr::LoopBound ||
+			e->type == Expr::SingleUse) {
+		data.push_back(e->context);
+		if (e->type == Expr::SingleUse) {
+			unsigned user_id = IDA.getValueID(e->u->getUser());
+			if (user_id == IDAssigner::InvalidID)
+				return false;
+			data.push_back(user_id);
+			data.push_back(e->u->getOperandNo());
+		} else {
+			if (!encode_value(e->v, IDA, data))
+				return false;
+		}
+		data.push_back(e->callstack.size());
+		for (size_t i = 0; i < e->callstack.size(); ++i) {
+			unsigned ins_id = IDA.getInstructionID(e->callstack[i]);
+			if (ins_id == IDAssigner::InvalidID)
+				return false;
+			data.push_back(ins_id);
+		}
+		return true;
+	}
+	data.push_back(e->op);
+	if (!encode_expr(e->e1, IDA, data))
+		return false;
+	if (e->type == Expr::Binary)
+		return encode_expr(e->e2, IDA, data);
+	assert(e->type == Expr::Unary);
+	return true;
+}
+
+static Expr *decode_expr(const vector<unsigned> &data, size_t &pos,
+		IDAssigner &IDA, LLVMContext &C) {
+	if (pos + 2 > data.size())
+		return NULL;
+	unsigned type = data[pos];
+	unsigned op_or_context = data[pos + 1];
+	pos += 2;
+	if (type == Expr::Unary) {
+		if (op_or_context != Instruction::ZExt &&
+				op_or_context != Instruction::SExt &&
+				op_or_context != Instruction::Trunc)
+			return NULL;
+		Expr *e1 = decode_expr(data, pos, IDA, C);
+		if (!e1)
+			return NULL;
+		return new Expr(op_or_context, e1);
+	}
+	if (type == Expr::Binary) {
+		switch (op_or_context) {
+			case Instruction::Add:
+			case Instruction::Sub:
+			case Instruction::Mul:
+			case Instruction::UDiv:
+			case Instruction::SDiv:
+			case Instruction::URem:
+			case Instruction::SRem:
+			case Instruction::Shl:
+			case Instruction::LShr:
+			case Instruction::AShr:
+			case Instruction::And:
+			case Instruction::Or:
+			case Instruction::Xor:
+				break;
+			default: return NULL;
+		}
+		Expr *e1 = decode_expr(data, pos, IDA, C);
+		if (!e1)
+			return NULL;
+		Expr *e2 = decode_expr(data, pos, IDA, C);
+		if (!e2 || e1->get_width() != e2->get_width()) {
+			delete e1;
+			delete e2;
+			return NULL;
+		}
+		return new Expr(op_or_context, e1, e2);
+	}
+
+	Expr *e;
+	if (type == Expr::SingleUse) {
+		if (pos + 2 > data.size())
+			return NULL;
+		const User *user = dyn_cast_or_null<User>(IDA.getValue(data[pos]));
+		if (!user || data[pos + 1] >= user->getNumOperands())
+			return NULL;
+		e = new Expr(&user->getOperandUse(data[pos + 1]), op_or_context);
+		pos += 2;
+	} else if (type == Expr::SingleDef || type == Expr::LoopBound) {
+		const Value *v = decode_value(data, pos, IDA, C);
+		if (!v)
+			return NULL;
+		e = new Expr(v, op_or_context, (Expr::Type)type);
+	} else {
+		return NULL;
+	}
+	if (pos >= data.size()) {
+		delete e;
+		return NULL;
+	}
+	unsigned n_callstack = data[pos++];
+	if (n_callstack > data.size() - pos) {
+		delete e;
+		return NULL;
+	}
+	for (unsigned i = 0; i < n_callstack; ++i) {
+		const Instruction *ins = IDA.getInstruction(data[pos++]);
+		if (!ins) {
+			delete e;
+			return NULL;
+		}
+		e->callstack.push_back(ins);
+	}
+	return e;
+}
+
+static bool encode_clause_rec(const Clause *c, IDAssigner &IDA,
+		vector<unsigned> &data) {
+	if (c->be) {
+		data.push_back(0);
+		data.push_back(c->be->p);
+		return encode_expr(c->be->e1, IDA, data) &&
+			encode_expr(c->be->e2, IDA, data);
+	}
+	data.push_back(c->op);
+	if (!encode_clause_rec(c->c1, IDA, data))
+		return false;
+	if (c->op == Instruction::UserOp1)
+		return true;
+	return encode_clause_rec(c->c2, IDA, data);
+}
+
+bool slicer::encode_clause(const Clause *c, IDAssigner &IDA,
+		vector<unsigned> &data) {
+	size_t old_size = data.size();
+	if (encode_clause_rec(c, IDA, data))
+		return true;
+	data.resize(old_size);
+	return false;
+}
+
+Clause *slicer::decode_clause(const vector<unsigned> &data, size_t &pos,
+		IDAssigner &IDA, LLVMContext &C) {
+	if (pos >= data.size())
+		return NULL;
+	unsigned op = data[pos++];
+	if (op == 0) {
+		if (pos >= data.size())
+			return NULL;
+		CmpInst::Predicate p = (CmpInst::Predicate)data[pos++];
+		if (!CmpInst::isIntPredicate(p))
+			return NULL;
+		Expr *e1 = decode_expr(data, pos, IDA, C);
+		if (!e1)
+			return NULL;
+		Expr *e2 = decode_expr(data, pos, IDA, C);
+		if (!e2) {
+			delete e1;
+			return NULL;
+		}
+		return new Clause(new BoolExpr(p, e1, e2));
+	}
+	if (op != Instruction::UserOp1 && op != Instruction::And &&
+			op != Instruction::Or && op != Instruction::Xor)
+		return NULL;
+	Clause *c1 = decode_clause(data, pos, IDA, C);
+	if (!c1)
+		return NULL;
+	if (op == Instruction::UserOp1)
+		return new Clause(op, c1);
+	Clause *c2 = decode_clause(data, pos, IDA, C);
+	if (!c2) {
+		delete c1;
+		return NULL;
+	}
+	return new Clause(op, c1, c2);
+}
+
 void ClauseVisitor::visit_clause(Clause *c) {
 	if (c->be)
 		visit_bool_expr(c->be);
@@ -140,9 +140,13 @@ void CaptureConstraints::check_loops(Module &M) {
 
 void CaptureConstraints::replace_with_loop_bound_version(
 		Clause *c, const Loop *l) {
+	// <c> is exclusively owned. Its children may be shared. 
 	if (c->be) {
+		unshare(c->be);
 		replace_with_loop_bound_version(c->be, l);
 	} else {
+		unshare(c->c1);
+		unshare(c->c2);
 		replace_with_loop_bound_version(c->c1, l);
 		replace_with_loop_bound_version(c->c2, l);
 	}
@@ -150,6 +154,8 @@ void CaptureConstraints::replace_with_loop_bound_version(
 
 void CaptureConstraints::replace_with_loop_bound_version(
 		BoolExpr *be, const Loop *l) {
+	unshare(be->e1);
+	unshare(be->e2);
 	replace_with_loop_bound_version(be->e1, l);
 	replace_with_loop_bound_version(be->e2, l);
 }
@@ -171,8 +177,11 @@ void CaptureConstraints::replace_with_loop_bound_version(
 	} else if (e->type == Expr::LoopBound) {
 		/* Nothing */
 	} else if (e->type == Expr::Unary) {
+		unshare(e->e1);
 		replace_with_loop_bound_version(e->e1, l);
 	} else if (e->type == Expr::Binary) {
+		unshare(e->e1);
+		unshare(e->e2);
 		replace_with_loop_bound_version(e->e1, l);
 		replace_with_loop_bound_version(e->e2, l);
 	} else {
@@ -199,17 +208,24 @@ bool CaptureConstraints::comes_from_shallow(
 }
 
 void CaptureConstraints::attach_context(Clause *c, unsigned context) {
-	if (c->be)
+	// <c> is exclusively owned. Its children may be shared. 
+	if (c->be) {
+		unshare(c->be);
 		attach_context(c->be, context);
-	else if (c->op == Instruction::UserOp1)
+	} else if (c->op == Instruction::UserOp1) {
+		unshare(c->c1);
 		attach_context(c->c1, context);
-	else {
+	} else {
+		unshare(c->c1);
+		unshare(c->c2);
 		attach_context(c->c1, context);
 		attach_context(c->c2, context);
 	}
 }
 
 void CaptureConstraints::attach_context(BoolExpr *be, unsigned context) {
+	unshare(be->e1);
+	unshare(be->e2);
 	attach_context(be->e1, context);
 	attach_context(be->e2, context);
 }
@@ -221,8 +237,11 @@ void CaptureConstraints::attach_context(Expr *e, unsigned context) {
 		if (!is_fixed_integer(v))
 			e->context = context;
 	} else if (e->type == Expr::Unary) {
+		unshare(e->e1);
 		attach_context(e->e1, context);
 	} else if (e->type == Expr::Binary) {
+		unshare(e->e1);
+		unshare(e->e2);
 		attach_context(e->e1, context);
 		attach_context(e->e2, context);
 	} else {
@@ -4,6 +4,9 @@
 
 #define DEBUG_TYPE "int"
 
+#include <algorithm>
+using namespace std;
+
 #include "llvm/Support/Debug.h"
 using namespace llvm;
 
@@ -28,97 +31,237 @@ MayWriteAnalyzer::MayWriteAnalyzer(): ModulePass(ID) {
 }
 
 bool MayWriteAnalyzer::runOnModule(Module &M) {
+	summaries.clear();
+	func_summaries.clear();
+	not_written.clear();
+	summarize_functions(M);
 	return false;
 }
 
-bool MayWriteAnalyzer::may_write(const Instruction *i,
-		const Value *q, ConstFuncSet &visited_funcs, bool trace_callee) {
-	if (const StoreInst *si = dyn_cast<StoreInst>(i)) {
-		if (may_alias(si->getPointerOperand(), q)) {
-			DEBUG(dbgs() << "may_write: ";);
-			DEBUG(dbgs() << "[" << si->getParent()->getParent()->getName() << "]";);
-			DEBUG(dbgs() << *si << "\n";);
-			return true;
-		}
-	}
+void MayWriteAnalyzer::add_written_pointers(const Instruction *i,
+		ConstValueList &pointers) {
+	if (const StoreInst *si = dyn_cast<StoreInst>(i))
+		pointers.push_back(si->getPointerOperand());
 
 	CallSite cs(const_cast<Instruction *>(i));
 	if (cs.getInstruction() && !is_pthread_create(i)) {
 		FPCallGraph &CG = getAnalysis<FPCallGraph>();
 		FuncList callees = CG.getCalledFunctions(i);
 		for (size_t j = 0; j < callees.size(); ++j) {
-			Function *callee = callees[j];
-			if (callee->isDeclaration()) {
-				if (libcall_may_write(cs, q)) {
-					DEBUG(dbgs() << "may_write:" << *i << "\n";);
-					return true;
-				}
-			} else {
-				// <callee> is an internal function. 
-				if (trace_callee) {
-					ExecOnce &EO = getAnalysis<ExecOnce>();
-					// Don't trace into exec-once functions, because they are already
-					// included in the partical ICFG and potentially included in the path. 
-					if (!EO.not_executed(callee) && !EO.executed_once(callee)) {
-						if (may_write(callee, q, visited_funcs))
-							return true;
-					}
-				}
+			if (callees[j]->isDeclaration()) {
+				get_libcall_written_pointers(cs, pointers);
+				break;
 			}
 		}
 	}
+}
+
+void MayWriteAnalyzer::get_traced_callees(const Instruction *i,
+		vector<const Function *> &traced) {
+	CallSite cs(const_cast<Instruction *>(i));
+	if (!cs.getInstruction() || is_pthread_create(i))
+		return;
+	FPCallGraph &CG = getAnalysis<FPCallGraph>();
+	ExecOnce &EO = getAnalysis<ExecOnce>();
+	FuncList callees = CG.getCalledFunctions(i);
+	for (size_t j = 0; j < callees.size(); ++j) {
+		Function *callee = callees[j];
+		if (callee->isDeclaration())
+			continue;
+		// Don't trace into exec-once functions, because they are already
+		// included in the partical ICFG and potentially included in the path. 
+		if (!EO.not_executed(callee) && !EO.executed_once(callee))
+			traced.push_back(callee);
+	}
+}
+
+bool MayWriteAnalyzer::may_write(const Instruction *i,
+		const Value *q, bool trace_callee) {
+	ConstValueList pointers;
+	add_written_pointers(i, pointers);
+	for (size_t j = 0; j < pointers.size(); ++j) {
+		if (may_alias(pointers[j], q)) {
+			DEBUG(dbgs() << "may_write: ";);
+			DEBUG(dbgs() << "[" << i->getParent()->getParent()->getName() << "]";);
+			DEBUG(dbgs() << *i << "\n";);
+			return true;
+		}
+	}
+
+	if (trace_callee) {
+		vector<const Function *> callees;
+		get_traced_callees(i, callees);
+		for (size_t j = 0; j < callees.size(); ++j) {
+			if (may_write(callees[j], q))
+				return true;
+		}
+	}
 
 	return false;
 }
 
-bool MayWriteAnalyzer::libcall_may_write(const CallSite &cs, const Value *q) {
+void MayWriteAnalyzer::get_libcall_written_pointers(const CallSite &cs,
+		ConstValueList &pointers) {
 	assert(cs.getInstruction());
 
 	if (Function *callee = cs.getCalledFunction()) {
 		if (callee->getName() == "fscanf") {
 			assert(cs.arg_size() >= 2);
-			for (unsigned arg_no = 2; arg_no < cs.arg_size(); ++arg_no) {
-				if (may_alias(cs.getArgument(arg_no), q))
-					return true;
-			}
+			for (unsigned arg_no = 2; arg_no < cs.arg_size(); ++arg_no)
+				pointers.push_back(cs.getArgument(arg_no));
 		}
 		if (callee->getName() == "BZ2_bzReadOpen" ||
 				callee->getName() == "BZ2_bzRead" ||
 				callee->getName() == "BZ2_bzReadGetUnused" ||
 				callee->getName() == "BZ2_bzReadClose") {
 			assert(cs.arg_size() >= 1);
-			if (may_alias(cs.getArgument(0), q))
-				return true;
+			pointers.push_back(cs.getArgument(0));
 		}
 		if (callee->getName().find("isoc99_scanf") != string::npos) {
 			assert(cs.arg_size() >= 1);
-			for (unsigned arg_no = 1; arg_no < cs.arg_size(); ++arg_no) {
-				if (may_alias(q, cs.getArgument(arg_no)))
-					return true;
-			}
+			for (unsigned arg_no = 1; arg_no < cs.arg_size(); ++arg_no)
+				pointers.push_back(cs.getArgument(arg_no));
 		}
 	}
+}
 
+bool MayWriteAnalyzer::libcall_may_write(const CallSite &cs, const Value *q) {
+	ConstValueList pointers;
+	get_libcall_written_pointers(cs, pointers);
+	for (size_t j = 0; j < pointers.size(); ++j) {
+		if (may_alias(pointers[j], q))
+			return true;
+	}
 	return false;
 }
 
-bool MayWriteAnalyzer::may_write(const Function *f,
-		const Value *q, ConstFuncSet &visited_funcs, bool trace_callee) {
-	if (visited_funcs.count(f))
-		return false;
-	visited_funcs.insert(f);
-
+bool MayWriteAnalyzer::may_write(const Function *f, const Value *q) {
 	if (f->isDeclaration())
 		return false;
-	
+	assert(func_summaries.count(f));
+	return summary_may_write(func_summaries.lookup(f), q);
+}
+
+void MayWriteAnalyzer::summarize_functions(Module &M) {
+	DenseMap<const Function *, unsigned> dfn, low;
+	vector<const Function *> stack;
+	ConstFuncSet on_stack;
+	for (Module::const_iterator f = M.begin(); f != M.end(); ++f) {
+		if (!f->isDeclaration() && !dfn.count(f))
+			summarize_scc(f, dfn, low, stack, on_stack);
+	}
+	assert(stack.empty());
+}
+
+// Tarjan's algorithm. An SCC is summarized when its root finishes, at
+// which point all its callees outside the SCC are already summarized. 
+void MayWriteAnalyzer::summarize_scc(const Function *f,
+		DenseMap<const Function *, unsigned> &dfn,
+		DenseMap<const Function *, unsigned> &low,
+		vector<const Function *> &stack, ConstFuncSet &on_stack) {
+	unsigned index = dfn.size();
+	dfn[f] = index;
+	low[f] = index;
+	stack.push_back(f);
+	on_stack.insert(f);
+
 	for (Function::const_iterator bi = f->begin(); bi != f->end(); ++bi) {
 		for (BasicBlock::const_iterator ii = bi->begin(); ii != bi->end(); ++ii) {
-			if (may_write(ii, q, visited_funcs, trace_callee))
-				return true;
+			vector<const Function *> callees;
+			get_traced_callees(ii, callees);
+			for (size_t j = 0; j < callees.size(); ++j) {
+				const Function *g = callees[j];
+				if (!dfn.count(g)) {
+					summarize_scc(g, dfn, low, stack, on_stack);
+					low[f] = min(low.lookup(f), low.lookup(g));
+				} else if (on_stack.count(g)) {
+					low[f] = min(low.lookup(f), dfn.lookup(g));
+				}
+			}
 		}
 	}
-	
-	return false;
+
+	if (low.lookup(f) != dfn.lookup(f))
+		return;
+
+	vector<const Function *> scc;
+	const Function *g;
+	do {
+		g = stack.back();
+		stack.pop_back();
+		on_stack.erase(g);
+		scc.push_back(g);
+	} while (g != f);
+
+	ConstValueSet pointers;
+	DenseSet<unsigned> callee_summaries;
+	for (size_t k = 0; k < scc.size(); ++k) {
+		for (Function::const_iterator bi = scc[k]->begin();
+				bi != scc[k]->end(); ++bi) {
+			for (BasicBlock::const_iterator ii = bi->begin();
+					ii != bi->end(); ++ii) {
+				ConstValueList written;
+				add_written_pointers(ii, written);
+				pointers.insert(written.begin(), written.end());
+				vector<const Function *> callees;
+				get_traced_callees(ii, callees);
+				for (size_t j = 0; j < callees.size(); ++j) {
+					// Callees in the same SCC are not summarized yet. 
+					if (func_summaries.count(callees[j]))
+						callee_summaries.insert(func_summaries.lookup(callees[j]));
+				}
+			}
+		}
+	}
+	unsigned summary_id = add_summary(pointers, callee_summaries);
+	for (size_t k = 0; k < scc.size(); ++k)
+		func_summaries[scc[k]] = summary_id;
+}
+
+unsigned MayWriteAnalyzer::add_summary(const ConstValueSet &pointers,
+		const DenseSet<unsigned> &callees) {
+	summaries.push_back(ModSummary());
+	ModSummary &s = summaries.back();
+	s.pointers.assign(pointers.begin(), pointers.end());
+	s.callees.assign(callees.begin(), callees.end());
+	return summaries.size() - 1;
+}
+
+unsigned MayWriteAnalyzer::summarize(const ConstInstList &insts) {
+	ConstValueSet pointers;
+	DenseSet<unsigned> callee_summaries;
+	for (size_t i = 0; i < insts.size(); ++i) {
+		ConstValueList written;
+		add_written_pointers(insts[i], written);
+		pointers.insert(written.begin(), written.end());
+		vector<const Function *> callees;
+		get_traced_callees(insts[i], callees);
+		for (size_t j = 0; j < callees.size(); ++j) {
+			assert(func_summaries.count(callees[j]));
+			callee_summaries.insert(func_summaries.lookup(callees[j]));
+		}
+	}
+	return add_summary(pointers, callee_summaries);
+}
+
+bool MayWriteAnalyzer::summary_may_write(unsigned summary_id,
+		const Value *q) {
+	assert(summary_id < summaries.size());
+	pair<unsigned, const Value *> key(summary_id, q);
+	if (not_written.count(key))
+		return false;
+
+	// <summaries> doesn't grow during the query. 
+	const ModSummary &s = summaries[summary_id];
+	bool res = false;
+	for (size_t j = 0; j < s.pointers.size() && !res; ++j)
+		res = may_alias(s.pointers[j], q);
+	// The call graph between summaries is acyclic. 
+	for (size_t j = 0; j < s.callees.size() && !res; ++j)
+		res = summary_may_write(s.callees[j], q);
+	if (!res)
+		not_written.insert(key);
+	return res;
 }
 
 bool MayWriteAnalyzer::may_alias(const Value *v1, const Value *v2) {
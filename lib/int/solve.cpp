@@ -9,10 +9,12 @@
 #include <list>
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 using namespace std;
 
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/Dominators.h"
 #include "llvm/Target/TargetData.h"
 using namespace llvm;
@@ -26,6 +28,7 @@ using namespace rcs;
 #include "slicer/capture.h"
 #include "slicer/solve.h"
 #include "slicer/adv-alias.h"
+#include "slicer/worker-pool.h"
 using namespace slicer;
 
 void SolveConstraints::getAnalysisUsage(AnalysisUsage &AU) const {
@@ -41,10 +44,33 @@ void SolveConstraints::getAnalysisUsage(AnalysisUsage &AU) const {
 	AU.addRequired<ExecOnce>();
 }
 
+static cl::opt<string> QueryCacheFile("query-cache",
+		cl::desc("The file that persists the solver results across runs "
+			"on the same bitcode"),
+		cl::init(""));
+
+static cl::opt<unsigned> SolverJobs("solver-jobs",
+		cl::desc("# of forked workers answering a batch of queries"),
+		cl::init(1));
+
+// A worker needs enough queries to pay for the fork. See worker-pool.h for
+// why the workers are processes. 
+static const unsigned MinQueriesPerJob = 64;
+
+static cl::opt<bool> ConstraintSlicing("slice-constraints",
+		cl::desc("Assert only the captured constraints connected with each "
+			"query instead of all of them"));
+
+STATISTIC(NumQueryCacheHits, "Number of solver queries answered by the cache");
+STATISTIC(NumQueryCacheMisses, "Number of solver queries sent to STP");
+STATISTIC(NumSlicedConstraints,
+		"Number of captured constraints asserted for solver queries");
+
 char SolveConstraints::ID = 0;
 
 SolveConstraints::SolveConstraints(): ModulePass(ID),
-	print_counterexample_(false),
+	module_fingerprint(0), calling_contexts_realized_(false),
+	recording_vars_(false), print_counterexample_(false),
 	print_asserts_(false), print_minimal_proof_set_(false)
 {
 }
@@ -52,9 +78,20 @@ SolveConstraints::SolveConstraints(): ModulePass(ID),
 void SolveConstraints::releaseMemory() {
 	// Principally paired with the create_vc in runOnModule. 
 	destroy_vc();
+	if (QueryCacheFile != "") {
+		if (!query_cache.save(QueryCacheFile, get_module_key_prefix()))
+			errs() << "[Warning] Cannot save the query cache\n";
+	}
+	query_cache.clear();
 }
 
 bool SolveConstraints::runOnModule(Module &M) {
+	if (QueryCacheFile != "") {
+		module_fingerprint =
+			getAnalysis<CaptureConstraints>().get_module_hash(M);
+		query_cache.load(QueryCacheFile);
+		DEBUG(dbgs() << "Loaded " << query_cache.size() << " cached queries\n";);
+	}
 	// Principally paired with the destroy_vc in releaseMemory.
 	create_vc();
 	calculate(M);
@@ -75,6 +112,18 @@ void SolveConstraints::calculate(Module &M) {
 	root.clear();
 	identify_eqs(); // This step does not require <vc>.
 	translate_captured(M);
+
+	CaptureConstraints &CC = getAnalysis<CaptureConstraints>();
+	ostringstream oss;
+	oss << get_module_key_prefix() << CC.get_fingerprint() << "." <<
+		CC.get_num_constraints();
+	state_fingerprint = oss.str();
+}
+
+string SolveConstraints::get_module_key_prefix() const {
+	ostringstream oss;
+	oss << module_fingerprint << ".";
+	return oss.str();
 }
 
 void SolveConstraints::identify_eq(const Value *v1, const Value *v2) {
@@ -208,6 +257,12 @@ void SolveConstraints::identify_fixed_values() {
 	// Find a satisfiable assignment. 
 	list<pair<const Value *, pair<unsigned, int> > > fixed_values;
 	list<pair<const Value *, pair<unsigned, int> > >::iterator i, j, to_del;
+
+	// Fixed values depend on all captured constraints. 
+	if (should_slice_constraints()) {
+		vc_push(vc);
+		assert_all_captured();
+	}
 	
 	vc_push(vc);
 	dbgs() << "Constructing a satisfying assignment... ";
@@ -277,6 +332,8 @@ void SolveConstraints::identify_fixed_values() {
 
 		vc_pop(vc);
 	}
+	if (should_slice_constraints())
+		vc_pop(vc);
 	
 	dbgs() << "\n";
 	dbgs() << "fixed = " << n_fixed << "; not fixed = " << n_not_fixed <<
@@ -441,22 +498,129 @@ void SolveConstraints::translate_captured(Module &M) {
 	dbgs() << "# of captured constraints = " << n_constraints << "\n";
 
 	assert(vc);
+	var_ids.clear();
+	var_parent.clear();
+	component_constraints.clear();
+	ground_constraints.clear();
+	touched_vars.clear();
+
+	// With slicing, the captured constraints are asserted only for checking
+	// the consistency. Queries assert what they need. 
+	if (should_slice_constraints())
+		vc_push(vc);
+	vector<pair<unsigned, unsigned> > var_of_constraint;
 	for (unsigned i = 0; i < n_constraints; ++i) {
 		Clause *c = CC.get_constraint(i)->clone();
 
+		recording_vars_ = should_slice_constraints();
 		VCExpr vce = translate_to_vc(c);
-		if (try_to_simplify(vce) == -1)
+		recording_vars_ = false;
+		if (try_to_simplify(vce) == -1) {
 			vc_assertFormula(vc, vce);
+			if (should_slice_constraints()) {
+				if (touched_vars.empty())
+					ground_constraints.push_back(i);
+				else {
+					// Union all variables of <c>. 
+					unsigned x = get_var_id(touched_vars[0]);
+					for (size_t j = 1; j < touched_vars.size(); ++j) {
+						unsigned y = get_var_id(touched_vars[j]);
+						var_parent[get_component(y)] = get_component(x);
+					}
+					var_of_constraint.push_back(make_pair(i, x));
+				}
+			}
+		}
+		touched_vars.clear();
 		vc_DeleteExpr(vce);
 		
 		delete c; // c is cloned
 	}
+	// Components are final only after all unions. 
+	for (size_t j = 0; j < var_of_constraint.size(); ++j) {
+		unsigned comp = get_component(var_of_constraint[j].second);
+		component_constraints[comp].push_back(var_of_constraint[j].first);
+	}
+	if (should_slice_constraints()) {
+		dbgs() << "# of constraint components = " <<
+			component_constraints.size() << "\n";
+	}
 
 	// The captured constraints should be consistent. 
-	check_consistency(M);
+	bool consistent = check_consistency(M);
+	if (should_slice_constraints())
+		vc_pop(vc);
+	if (!consistent)
+		diagnose(M);
+	assert(consistent && "The captured constraints is inconsistent.");
+}
+
+bool SolveConstraints::should_slice_constraints() const {
+	return ConstraintSlicing;
+}
+
+unsigned SolveConstraints::get_var_id(const string &name) {
+	StringMap<unsigned>::iterator it = var_ids.find(name);
+	if (it != var_ids.end())
+		return it->getValue();
+	unsigned x = var_parent.size();
+	var_ids[name] = x;
+	var_parent.push_back(x);
+	return x;
+}
+
+unsigned SolveConstraints::get_component(unsigned x) {
+	unsigned r = x;
+	while (var_parent[r] != r)
+		r = var_parent[r];
+	// Path compression. 
+	while (var_parent[x] != r) {
+		unsigned next = var_parent[x];
+		var_parent[x] = r;
+		x = next;
+	}
+	return r;
+}
+
+void SolveConstraints::assert_captured(unsigned i) {
+	CaptureConstraints &CC = getAnalysis<CaptureConstraints>();
+	// Same as what <translate_captured> asserts. 
+	Clause *c = CC.get_constraint(i)->clone();
+	VCExpr vce = translate_to_vc(c);
+	if (try_to_simplify(vce) == -1) {
+		vc_assertFormula(vc, vce);
+		++NumSlicedConstraints;
+	}
+	vc_DeleteExpr(vce);
+	delete c;
 }
 
-void SolveConstraints::check_consistency(Module &M) {
+void SolveConstraints::assert_captured_in_cone() {
+	DenseSet<unsigned> components;
+	for (size_t j = 0; j < touched_vars.size(); ++j) {
+		StringMap<unsigned>::iterator it = var_ids.find(touched_vars[j]);
+		if (it != var_ids.end())
+			components.insert(get_component(it->getValue()));
+	}
+
+	assert(!recording_vars_);
+	for (size_t j = 0; j < ground_constraints.size(); ++j)
+		assert_captured(ground_constraints[j]);
+	for (DenseSet<unsigned>::iterator it = components.begin();
+			it != components.end(); ++it) {
+		const vector<unsigned> &constraints = component_constraints[*it];
+		for (size_t j = 0; j < constraints.size(); ++j)
+			assert_captured(constraints[j]);
+	}
+}
+
+void SolveConstraints::assert_all_captured() {
+	CaptureConstraints &CC = getAnalysis<CaptureConstraints>();
+	for (unsigned i = 0; i < CC.get_num_constraints(); ++i)
+		assert_captured(i);
+}
+
+bool SolveConstraints::check_consistency(Module &M) {
 	dbgs() << "Checking consistency... ";
 	vc_push(vc);
 	if (print_asserts_) {
@@ -469,12 +633,8 @@ void SolveConstraints::check_consistency(Module &M) {
 	vc_DeleteExpr(f);
 	vc_pop(vc);
 
-	if (ret != 0) {
-		diagnose(M);
-		// CC.print(errs(), &M);
-	}
-	assert(ret == 0 && "The captured constraints is inconsistent.");
 	dbgs() << "Done\n";
+	return ret == 0;
 }
 
 ConstantInt *SolveConstraints::get_fixed_value(const Value *v) {
@@ -489,17 +649,24 @@ ConstantInt *SolveConstraints::get_fixed_value(const Value *v) {
 }
 
 void SolveConstraints::replace_with_root(Clause *c) {
-	if (c->be)
+	// <c> is exclusively owned. Its children may be shared. 
+	if (c->be) {
+		unshare(c->be);
 		replace_with_root(c->be);
-	else if (c->op == Instruction::UserOp1)
+	} else if (c->op == Instruction::UserOp1) {
+		unshare(c->c1);
 		replace_with_root(c->c1);
-	else {
+	} else {
+		unshare(c->c1);
+		unshare(c->c2);
 		replace_with_root(c->c1);
 		replace_with_root(c->c2);
 	}
 }
 
 void SolveConstraints::replace_with_root(BoolExpr *be) {
+	unshare(be->e1);
+	unshare(be->e2);
 	replace_with_root(be->e1);
 	replace_with_root(be->e2);
 }
@@ -511,8 +678,11 @@ void SolveConstraints::replace_with_root(Expr *e) {
 		e->type = Expr::SingleDef;
 		e->v = get_root(e->u->get());
 	} else if (e->type == Expr::Unary) {
+		unshare(e->e1);
 		replace_with_root(e->e1);
 	} else if (e->type == Expr::Binary) {
+		unshare(e->e1);
+		unshare(e->e2);
 		replace_with_root(e->e1);
 		replace_with_root(e->e2);
 	} else {
@@ -576,17 +746,17 @@ bool SolveConstraints::satisfiable(const Clause *c) {
 
 	Clause *c2 = c->clone();
 	replace_with_root(c2);
-	// OPT: if in the format of v0 == v0, then must be true. 
-	const Value *v1 = NULL, *v2 = NULL;
-	if (is_simple_eq(c2, &v1, &v2) && v1 == v2) {
+	if (is_trivially_true(c2)) {
 		delete c2;
 		return true;
 	}
-	delete c2;
 
+	// NOT <c2> is <not_c> after <replace_with_root>. 
 	Clause *not_c = new Clause(Instruction::UserOp1, c->clone());
-	bool sat = !provable(not_c);
+	Clause *not_c2 = new Clause(Instruction::UserOp1, c2);
+	bool sat = !provable_rooted(not_c, not_c2);
 	delete not_c;
+	delete not_c2;
 
 	return sat;
 }
@@ -598,19 +768,60 @@ bool SolveConstraints::provable(const Clause *c) {
 
 	Clause *c2 = c->clone();
 	replace_with_root(c2);
+	bool ret = provable_rooted(c, c2);
+	delete c2;
+	return ret;
+}
+
+bool SolveConstraints::provable_rooted(const Clause *c, const Clause *rooted) {
+	string key;
+	int quick = try_to_prove_quickly(c, rooted, key);
+	if (quick != -1)
+		return quick == 1;
+
+	bool ret = query_vc(c, rooted);
+	if (should_use_query_cache())
+		query_cache.insert(key, ret);
+	return ret;
+}
+
+bool SolveConstraints::is_trivially_true(const Clause *rooted) {
 	// OPT: If is in the format of v0 == v0, then must be true.
 	// FIXME: This may not be right, the realized constraints may contain
 	// conflicts. 
 	const Value *v1 = NULL, *v2 = NULL;
-	if (is_simple_eq(c2, &v1, &v2) && v1 == v2) {
-		delete c2;
-		return true;
+	return is_simple_eq(rooted, &v1, &v2) && v1 == v2;
+}
+
+int SolveConstraints::try_to_prove_quickly(const Clause *c,
+		const Clause *rooted, string &key) {
+	if (is_trivially_true(rooted))
+		return 1;
+
+	int ret = -1;
+	if (should_use_query_cache()) {
+		key = get_query_key(c, rooted);
+		bool cached;
+		if (query_cache.lookup(key, cached)) {
+			++NumQueryCacheHits;
+			ret = (cached ? 1 : 0);
+		} else {
+			++NumQueryCacheMisses;
+		}
 	}
+	return ret;
+}
 
+bool SolveConstraints::query_vc(const Clause *c, const Clause *rooted) {
 	vc_push(vc);
+	// Variables touched by an enclosing scope stay relevant. 
+	size_t n_touched = touched_vars.size();
+	recording_vars_ = should_slice_constraints();
 	realize(c);
-	VCExpr vce = translate_to_vc(c2);
-	delete c2;
+	VCExpr vce = translate_to_vc(rooted);
+	recording_vars_ = false;
+	if (should_slice_constraints())
+		assert_captured_in_cone();
 
 	if (print_asserts_) {
 		vc_printVarDecls(vc);
@@ -626,6 +837,7 @@ bool SolveConstraints::provable(const Clause *c) {
 	if (ret == 0 && print_counterexample_)
 		print_counterexample();
 	vc_pop(vc);
+	touched_vars.resize(n_touched);
 
 	if (ret == 1 && print_minimal_proof_set_)
 		print_minimal_proof_set(c);
@@ -633,6 +845,238 @@ bool SolveConstraints::provable(const Clause *c) {
 	return ret == 1;
 }
 
+namespace slicer {
+	/*
+	 * Queries are sorted by their calling contexts. Consecutive queries
+	 * under the same calling contexts share one scope in <vc> where the
+	 * calling contexts are realized only once. 
+	 */
+	struct ProvableTask: public WorkerTask {
+		ProvableTask(SolveConstraints &s, const vector<const Clause *> &q,
+				const vector<const Clause *> &r, const vector<string> &ctxts):
+			SC(s), queries(q), rooted(r), contexts(ctxts), in_scope(false),
+			n_touched(0) {}
+
+		virtual int run(unsigned i) {
+			if (!in_scope || contexts[i] != cur_contexts) {
+				finish();
+				vc_push(SC.vc);
+				n_touched = SC.touched_vars.size();
+				SC.recording_vars_ = SC.should_slice_constraints();
+				SC.realize_calling_contexts(queries[i]);
+				SC.recording_vars_ = false;
+				SC.calling_contexts_realized_ = true;
+				cur_contexts = contexts[i];
+				in_scope = true;
+			}
+			return SC.query_vc(queries[i], rooted[i]);
+		}
+
+		virtual void finish() {
+			if (in_scope) {
+				SC.calling_contexts_realized_ = false;
+				vc_pop(SC.vc);
+				SC.touched_vars.resize(n_touched);
+				in_scope = false;
+			}
+		}
+
+		SolveConstraints &SC;
+		const vector<const Clause *> &queries;
+		// <queries> after <replace_with_root>. 
+		const vector<const Clause *> &rooted;
+		const vector<string> &contexts;
+		bool in_scope;
+		string cur_contexts;
+		// Size of SC.touched_vars before the scope. 
+		size_t n_touched;
+	};
+
+	struct CompareByContexts {
+		CompareByContexts(const vector<string> &c): contexts(c) {}
+		bool operator()(unsigned a, unsigned b) const {
+			return contexts[a] < contexts[b];
+		}
+		const vector<string> &contexts;
+	};
+}
+
+void SolveConstraints::provable(const vector<const Clause *> &cs,
+		vector<bool> &results) {
+	vector<const Clause *> rooted;
+	for (size_t i = 0; i < cs.size(); ++i) {
+		Clause *c2 = cs[i]->clone();
+		replace_with_root(c2);
+		rooted.push_back(c2);
+	}
+	provable_rooted(cs, rooted, results);
+	for (size_t i = 0; i < rooted.size(); ++i)
+		delete rooted[i];
+}
+
+void SolveConstraints::provable_rooted(const vector<const Clause *> &cs,
+		const vector<const Clause *> &rooted, vector<bool> &results) {
+	results.assign(cs.size(), false);
+
+	// Answer what we can without the solver. 
+	vector<const Clause *> misses, rooted_misses;
+	vector<string> miss_keys;
+	// <cs>[i] is answered by misses[which_miss[i]] if it's not -1. 
+	vector<int> which_miss(cs.size(), -1);
+	StringMap<unsigned> key_to_miss;
+	for (size_t i = 0; i < cs.size(); ++i) {
+		string key;
+		int quick = try_to_prove_quickly(cs[i], rooted[i], key);
+		if (quick != -1) {
+			results[i] = (quick == 1);
+			continue;
+		}
+		// Identical queries in the batch go to the solver only once. 
+		if (key != "" && key_to_miss.count(key)) {
+			which_miss[i] = key_to_miss.lookup(key);
+			continue;
+		}
+		which_miss[i] = misses.size();
+		if (key != "")
+			key_to_miss[key] = misses.size();
+		misses.push_back(cs[i]);
+		rooted_misses.push_back(rooted[i]);
+		miss_keys.push_back(key);
+	}
+
+	// Small batches are not worth forking. Workers' outputs would be lost,
+	// so don't fork when printing either. 
+	unsigned n_jobs = SolverJobs;
+	if (misses.size() < MinQueriesPerJob || !should_use_query_cache())
+		n_jobs = 1;
+
+	// Group the queries under the same calling contexts. 
+	vector<string> contexts(misses.size());
+	for (size_t j = 0; j < misses.size(); ++j) {
+		raw_string_ostream oss(contexts[j]);
+		print_calling_contexts(oss, misses[j]);
+		oss.flush();
+	}
+	vector<unsigned> order(misses.size());
+	for (size_t j = 0; j < misses.size(); ++j)
+		order[j] = j;
+	stable_sort(order.begin(), order.end(), CompareByContexts(contexts));
+	vector<const Clause *> sorted_misses(misses.size());
+	vector<const Clause *> sorted_rooted(misses.size());
+	vector<string> sorted_contexts(misses.size());
+	for (size_t k = 0; k < order.size(); ++k) {
+		sorted_misses[k] = misses[order[k]];
+		sorted_rooted[k] = rooted_misses[order[k]];
+		sorted_contexts[k] = contexts[order[k]];
+	}
+
+	ProvableTask task(*this, sorted_misses, sorted_rooted, sorted_contexts);
+	vector<int> sorted_results;
+	run_in_workers(task, sorted_misses.size(), n_jobs, sorted_results);
+	vector<int> miss_results(misses.size());
+	for (size_t k = 0; k < order.size(); ++k)
+		miss_results[order[k]] = sorted_results[k];
+	for (size_t i = 0; i < cs.size(); ++i) {
+		if (which_miss[i] != -1)
+			results[i] = miss_results[which_miss[i]];
+	}
+	if (should_use_query_cache()) {
+		for (size_t j = 0; j < misses.size(); ++j)
+			query_cache.insert(miss_keys[j], miss_results[j]);
+	}
+}
+
+void SolveConstraints::satisfiable(const vector<const Clause *> &cs,
+		vector<bool> &results) {
+	results.assign(cs.size(), true);
+
+	// satisfiable(c) == !provable(NOT c)
+	vector<const Clause *> negated, rooted_negated;
+	vector<size_t> which_query;
+	for (size_t i = 0; i < cs.size(); ++i) {
+		Clause *c2 = cs[i]->clone();
+		replace_with_root(c2);
+		if (is_trivially_true(c2)) {
+			delete c2;
+			continue;
+		}
+		negated.push_back(new Clause(Instruction::UserOp1, cs[i]->clone()));
+		rooted_negated.push_back(new Clause(Instruction::UserOp1, c2));
+		which_query.push_back(i);
+	}
+	vector<bool> proved;
+	provable_rooted(negated, rooted_negated, proved);
+	for (size_t j = 0; j < negated.size(); ++j) {
+		results[which_query[j]] = !proved[j];
+		delete negated[j];
+		delete rooted_negated[j];
+	}
+}
+
+bool SolveConstraints::should_use_query_cache() const {
+	// Cached queries wouldn't print anything. 
+	return !print_counterexample_ && !print_asserts_ &&
+		!print_minimal_proof_set_;
+}
+
+string SolveConstraints::get_query_key(const Clause *c, const Clause *rooted) {
+	string str;
+	raw_string_ostream oss(str);
+	oss << state_fingerprint << " ";
+	print_clause(oss, rooted, getAnalysis<IDAssigner>());
+	oss << " ";
+	print_realize_key(oss, c);
+	return oss.str();
+}
+
+/*
+ * Prints what <realize> depends on besides the clause itself. 
+ * Must be consistent with <realize>. 
+ */
+void SolveConstraints::print_realize_key(raw_ostream &O, const Clause *c) {
+	if (c->be)
+		print_realize_key(O, c->be);
+	else if (c->op == Instruction::UserOp1)
+		print_realize_key(O, c->c1);
+	else {
+		print_realize_key(O, c->c1);
+		print_realize_key(O, c->c2);
+	}
+}
+
+void SolveConstraints::print_realize_key(raw_ostream &O, const BoolExpr *be) {
+	print_realize_key(O, be->e1);
+	print_realize_key(O, be->e2);
+}
+
+void SolveConstraints::print_realize_key(raw_ostream &O, const Expr *e) {
+	IDAssigner &IDA = getAnalysis<IDAssigner>();
+	if (e->type == Expr::Unary) {
+		print_realize_key(O, e->e1);
+	} else if (e->type == Expr::Binary) {
+		print_realize_key(O, e->e1);
+		print_realize_key(O, e->e2);
+	} else if (e->type == Expr::SingleUse) {
+		if (isa<Instruction>(e->u->getUser()))
+			O << "u" << IDA.getValueID(e->u->getUser()) << "_" << e->context;
+		O << ";";
+	} else if (e->type == Expr::SingleDef) {
+		if (isa<Instruction>(e->v)) {
+			O << "x" << IDA.getValueID(e->v) << "_" << e->context;
+		} else if (const Argument *arg = dyn_cast<Argument>(e->v)) {
+			// The callee whose call edge <realize> adds.
+			O << "a" << arg->getParent()->getName() << "." << arg->getArgNo()
+				<< "_" << e->context;
+		}
+		for (size_t i = 0; i < e->callstack.size(); ++i)
+			O << "@" << IDA.getValueID(e->callstack[i]);
+		O << ";";
+	} else {
+		assert(e->type == Expr::LoopBound);
+		assert(false && "Type LoopBound shouldn't be used in a query");
+	}
+}
+
 void SolveConstraints::realize(const Clause *c) {
 	if (c->be)
 		realize(c->be);
@@ -688,6 +1132,17 @@ void SolveConstraints::realize(const ConstInstList &callstack,
 	// Realize <ins> itself. 
 	if (const Instruction *ins = dyn_cast<Instruction>(v))
 		realize(ins, context);
+	// A batch may have realized the calling context already. 
+	if (!calling_contexts_realized_)
+		realize_calling_context(callstack, context);
+	if (callstack.size() > 0) {
+		if (const Function *container = get_container(v))
+			realize_function_call(callstack.back(), container, context);
+	}
+}
+
+void SolveConstraints::realize_calling_context(const ConstInstList &callstack,
+		unsigned context) {
 	// Realize each call instruction. 
 	for (size_t i = 0; i < callstack.size(); ++i)
 		realize(callstack[i], context);
@@ -696,9 +1151,55 @@ void SolveConstraints::realize(const ConstInstList &callstack,
 		realize_function_call(callstack[i],
 				callstack[i + 1]->getParent()->getParent(), context);
 	}
-	if (callstack.size() > 0) {
-		if (const Function *container = get_container(v))
-			realize_function_call(callstack.back(), container, context);
+}
+
+void SolveConstraints::realize_calling_contexts(const Clause *c) {
+	if (c->be) {
+		realize_calling_contexts(c->be->e1);
+		realize_calling_contexts(c->be->e2);
+	} else if (c->op == Instruction::UserOp1) {
+		realize_calling_contexts(c->c1);
+	} else {
+		realize_calling_contexts(c->c1);
+		realize_calling_contexts(c->c2);
+	}
+}
+
+void SolveConstraints::realize_calling_contexts(const Expr *e) {
+	if (e->type == Expr::Unary) {
+		realize_calling_contexts(e->e1);
+	} else if (e->type == Expr::Binary) {
+		realize_calling_contexts(e->e1);
+		realize_calling_contexts(e->e2);
+	} else if (e->type == Expr::SingleDef) {
+		realize_calling_context(e->callstack, e->context);
+	}
+}
+
+void SolveConstraints::print_calling_contexts(raw_ostream &O, const Clause *c) {
+	if (c->be) {
+		print_calling_contexts(O, c->be->e1);
+		print_calling_contexts(O, c->be->e2);
+	} else if (c->op == Instruction::UserOp1) {
+		print_calling_contexts(O, c->c1);
+	} else {
+		print_calling_contexts(O, c->c1);
+		print_calling_contexts(O, c->c2);
+	}
+}
+
+void SolveConstraints::print_calling_contexts(raw_ostream &O, const Expr *e) {
+	if (e->type == Expr::Unary) {
+		print_calling_contexts(O, e->e1);
+	} else if (e->type == Expr::Binary) {
+		print_calling_contexts(O, e->e1);
+		print_calling_contexts(O, e->e2);
+	} else if (e->type == Expr::SingleDef && !e->callstack.empty()) {
+		IDAssigner &IDA = getAnalysis<IDAssigner>();
+		O << e->context << ":";
+		for (size_t i = 0; i < e->callstack.size(); ++i)
+			O << IDA.getValueID(e->callstack[i]) << ",";
+		O << ";";
 	}
 }
 
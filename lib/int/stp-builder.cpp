@@ -233,6 +233,23 @@ VCExpr SolveConstraints::translate_to_vc(const Value *v,
 		return vc_zero(vc);
 	}
 
+	string name = get_var_name(v, context, is_loop_bound);
+	if (recording_vars_)
+		touched_vars.push_back(name);
+	VCType vct = (v->getType()->isIntegerTy(1) ?
+			vc_bvType(vc, 1) :
+			vc_bv32Type(vc));
+	VCExpr symbol = vc_varExpr(vc, name.c_str(), vct);
+	vc_DeleteExpr(vct);
+
+	return symbol;
+}
+
+string SolveConstraints::get_var_name(const Value *v,
+		unsigned context, bool is_loop_bound) {
+	if (isa<ConstantInt>(v) || isa<ConstantPointerNull>(v))
+		return "";
+
 	IDAssigner &IDA = getAnalysis<IDAssigner>();
 	unsigned value_id = IDA.getValueID(v);
 	assert(value_id != IDAssigner::InvalidID);
@@ -241,15 +258,7 @@ VCExpr SolveConstraints::translate_to_vc(const Value *v,
 	oss << (is_loop_bound ? "lb": "x") << value_id;
 	if (context != 0)
 		oss << "_" << context;
-
-	string name = oss.str();
-	VCType vct = (v->getType()->isIntegerTy(1) ?
-			vc_bvType(vc, 1) :
-			vc_bv32Type(vc));
-	VCExpr symbol = vc_varExpr(vc, name.c_str(), vct);
-	vc_DeleteExpr(vct);
-
-	return symbol;
+	return oss.str();
 }
 
 VCExpr SolveConstraints::translate_to_vc(const Use *u, unsigned context) {
@@ -8,6 +8,7 @@
 #include "llvm/LLVMContext.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Transforms/Utils/ValueMapper.h"
 #include "rcs/FPCallGraph.h"
 #include "rcs/Exec.h"
@@ -23,13 +24,117 @@ using namespace std;
 
 #include "slicer/max-slicing.h"
 #include "slicer/landmark-trace.h"
+#include "slicer/worker-pool.h"
 using namespace slicer;
 
+STATISTIC(NumReusedTrunks, "Number of trunks whose CFGs are reused");
+
+static cl::opt<unsigned> CFGJobs("max-slicing-jobs",
+		cl::desc("# of forked workers computing the CFGs of threads"),
+		cl::init(1));
+
+namespace slicer {
+	// Computes the TrunkCFGs of a thread in a worker. See worker-pool.h. 
+	struct ThreadCFGTask: public ListWorkerTask {
+		ThreadCFGTask(MaxSlicing &m, const vector<int> &t):
+			MS(m), thr_ids(t) {}
+
+		// The encoded trunks followed by the number of reused trunks. 
+		virtual void run(unsigned i, vector<unsigned> &result) {
+			vector<MaxSlicing::TrunkCFG> trunks;
+			unsigned n_reused = MS.compute_cfg_of_thread(thr_ids[i], trunks);
+			MS.encode_trunk_cfgs(trunks, result);
+			result.push_back(n_reused);
+		}
+
+	private:
+		MaxSlicing &MS;
+		const vector<int> &thr_ids;
+	};
+}
+
 void MaxSlicing::add_cfg_edge(Instruction *x, Instruction *y) {
 	assert(clone_map_r.count(x) && "<x> must be in the cloned CFG");
 	assert(clone_map_r.count(y) && "<y> must be in the cloned CFG");
-	cfg[x].push_back(y);
-	cfg_r[y].push_back(x);
+	cfg.add_edge(x, y);
+}
+
+void MaxSlicing::ClonedCFG::clear() {
+	ids.clear();
+	edges.clear();
+	succ_offsets.clear();
+	pred_offsets.clear();
+	succs.clear();
+	preds.clear();
+	finalized = false;
+}
+
+void MaxSlicing::ClonedCFG::add_node(Instruction *x) {
+	assert(!finalized);
+	assert(!ids.count(x));
+	unsigned id = ids.size();
+	ids[x] = id;
+}
+
+void MaxSlicing::ClonedCFG::add_edge(Instruction *x, Instruction *y) {
+	assert(!finalized);
+	assert(ids.count(x) && ids.count(y));
+	edges.push_back(make_pair(ids.lookup(x), ids.lookup(y)));
+}
+
+void MaxSlicing::ClonedCFG::finalize() {
+	assert(!finalized);
+	build_rows(false, succ_offsets, succs);
+	build_rows(true, pred_offsets, preds);
+	edges.clear();
+	finalized = true;
+}
+
+void MaxSlicing::ClonedCFG::build_rows(bool reversed,
+		vector<unsigned> &offsets, InstList &targets) const {
+	unsigned n = ids.size();
+	InstList nodes(n);
+	for (DenseMap<Instruction *, unsigned>::const_iterator it = ids.begin();
+			it != ids.end(); ++it)
+		nodes[it->second] = it->first;
+
+	// Counting sort. Keeps the order in which the edges were added. 
+	offsets.assign(n + 1, 0);
+	for (size_t i = 0; i < edges.size(); ++i) {
+		unsigned from = (reversed ? edges[i].second : edges[i].first);
+		++offsets[from + 1];
+	}
+	for (unsigned i = 0; i < n; ++i)
+		offsets[i + 1] += offsets[i];
+	targets.assign(edges.size(), NULL);
+	vector<unsigned> next(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < edges.size(); ++i) {
+		unsigned from = (reversed ? edges[i].second : edges[i].first);
+		unsigned to = (reversed ? edges[i].first : edges[i].second);
+		targets[next[from]++] = nodes[to];
+	}
+}
+
+ArrayRef<Instruction *> MaxSlicing::ClonedCFG::get_row(Instruction *x,
+		const vector<unsigned> &offsets, const InstList &targets) const {
+	assert(finalized && "The cloned CFG is not finalized yet");
+	DenseMap<Instruction *, unsigned>::const_iterator it = ids.find(x);
+	if (it == ids.end())
+		return ArrayRef<Instruction *>();
+	unsigned s = offsets[it->second], e = offsets[it->second + 1];
+	if (s == e)
+		return ArrayRef<Instruction *>();
+	return ArrayRef<Instruction *>(&targets[s], e - s);
+}
+
+ArrayRef<Instruction *> MaxSlicing::ClonedCFG::successors(
+		Instruction *x) const {
+	return get_row(x, succ_offsets, succs);
+}
+
+ArrayRef<Instruction *> MaxSlicing::ClonedCFG::predecessors(
+		Instruction *x) const {
+	return get_row(x, pred_offsets, preds);
 }
 
 void MaxSlicing::compute_reachability(Function *f) {
@@ -86,20 +191,52 @@ void MaxSlicing::build_cfg(Module &M) {
 
 	// Initialize global variables related to building CFG. 
 	cfg.clear();
-	cfg_r.clear();
 	clone_map.clear();
 	clone_map_r.clear();
 	cloned_to_trunk.clear();
 	cloned_to_tid.clear();
+	trunk_cache.clear();
 
 #if 0
 	// Compute <reach_start> and <reach_end>.
 	compute_reachability(M);
 #endif
 
-	forallconst(Trace, it, trace) {
-		// it->first: thread ID
-		build_cfg_of_thread(M, it->first);
+	// Compute the trunks of each thread in parallel. They only read the
+	// original program. 
+	vector<int> thr_ids;
+	forallconst(Trace, it, trace)
+		thr_ids.push_back(it->first);
+	vector<vector<TrunkCFG> > thread_trunks(thr_ids.size());
+	if (CFGJobs > 1) {
+		ThreadCFGTask task(*this, thr_ids);
+		vector<vector<unsigned> > encoded;
+		run_in_workers(task, thr_ids.size(), CFGJobs, encoded);
+		for (size_t k = 0; k < thr_ids.size(); ++k) {
+			// Statistics bumped in the workers are lost. 
+			assert(!encoded[k].empty());
+			NumReusedTrunks += encoded[k].back();
+			encoded[k].pop_back();
+			decode_trunk_cfgs(encoded[k], thread_trunks[k]);
+		}
+	} else {
+		for (size_t k = 0; k < thr_ids.size(); ++k)
+			NumReusedTrunks += compute_cfg_of_thread(thr_ids[k], thread_trunks[k]);
+	}
+
+	// Clone the instructions and merge the CFGs of all threads. 
+	for (size_t k = 0; k < thr_ids.size(); ++k)
+		build_cfg_of_thread(M, thr_ids[k], thread_trunks[k]);
+	cfg.finalize();
+
+	// Assign containers. 
+	for (size_t k = 0; k < thr_ids.size(); ++k) {
+		int thr_id = thr_ids[k];
+		DEBUG(dump_thr_cfg(thr_id););
+		assert(clone_map[thr_id].size() > 0);
+		Instruction *start = clone_map[thr_id][0].lookup(trace[thr_id][0]);
+		assert(start);
+		assign_containers(M, start);
 	}
 	// Every instructions in the cloned program should have parent BBs and
 	// parent functions.
@@ -112,14 +249,14 @@ void MaxSlicing::build_cfg(Module &M) {
 	dbgs() << "Done building CFG\n";
 }
 
-void MaxSlicing::dump_thr_cfg(const CFG &cfg, int thr_id) {
+void MaxSlicing::dump_thr_cfg(int thr_id) {
 	dbgs() << "Printing CFG of Thread " << thr_id << "...\n";
 	IDManager &IDM = getAnalysis<IDManager>();
 	for (size_t i = 0; i < clone_map[thr_id].size(); ++i) {
 		forall(InstMapping, it, clone_map[thr_id][i]) {
 			Instruction *orig = it->first;
 			Instruction *cloned = it->second;
-			const InstList &next_insts = cfg.lookup(cloned);
+			ArrayRef<Instruction *> next_insts = cfg.successors(cloned);
 			for (size_t j = 0; j < next_insts.size(); ++j) {
 				Instruction *cloned_next = next_insts[j];
 				Instruction *orig_next = clone_map_r[cloned_next];
@@ -188,16 +325,13 @@ void MaxSlicing::assign_containers(Module &M, Instruction *start) {
 	q.push(start);
 	while (!q.empty()) {
 		Instruction *x = q.front();
-		CFG::iterator it = cfg.find(x);
-		if (it != cfg.end()) {
-			const InstList &next_insts = it->second;
-			for (size_t j = 0, E = next_insts.size(); j < E; ++j) {
-				Instruction *y = next_insts[j];
-				if (!level.count(y)) {
-					assign_level(y, x, level);
-					parent[y] = x;
-					q.push(y);
-				}
+		ArrayRef<Instruction *> next_insts = cfg.successors(x);
+		for (size_t j = 0, E = next_insts.size(); j < E; ++j) {
+			Instruction *y = next_insts[j];
+			if (!level.count(y)) {
+				assign_level(y, x, level);
+				parent[y] = x;
+				q.push(y);
 			}
 		}
 		q.pop();
@@ -211,7 +345,7 @@ void MaxSlicing::assign_containers(Module &M, Instruction *start) {
 		if (!x->getParent()) {
 			assign_container(M, x, level, parent);
 			// Continue BFSing.
-			const InstList &next_insts = cfg.lookup(x);
+			ArrayRef<Instruction *> next_insts = cfg.successors(x);
 			for (size_t j = 0, E = next_insts.size(); j < E; ++j)
 				q.push(next_insts[j]);
 		}
@@ -324,10 +458,10 @@ Instruction *MaxSlicing::clone_inst(
 	return y;
 }
 
-void MaxSlicing::build_cfg_of_thread(Module &M, int thr_id) {
-	dbgs() << "Building CFG of Thread " << thr_id << "...\n";
-	
-	clone_map[thr_id].clear();
+unsigned MaxSlicing::compute_cfg_of_thread(int thr_id,
+		vector<TrunkCFG> &trunks) {
+	dbgs() << "Computing CFG of Thread " << thr_id << "...\n";
+
 	assert(trace.count(thr_id));
 	const InstList &thr_trace = trace.find(thr_id)->second;
 	assert(thr_trace.size() > 0);
@@ -335,32 +469,54 @@ void MaxSlicing::build_cfg_of_thread(Module &M, int thr_id) {
 	/*
 	 * If there is only one trunk, the control flow contains only one node
 	 * and zero edges. 
+	 * Otherwise, iterate through each trunk except the last one. 
+	 * The last instruction is automatically added when processing the
+	 * second-to-last trunk. 
 	 */
+	trunks.clear();
+	unsigned n_reused = 0;
+	for (size_t i = 0, E = thr_trace.size(); i + 1 < E; ++i) {
+		dbgs() << "Computing CFG of Trunk " << i << "...\n";
+		DEBUG(dbgs() << "  " << *thr_trace[i] << "\n";
+		dbgs() << "  " << *thr_trace[i + 1] << "\n";
+		print_call_stack(dbgs(), call_stack););
+		// <i> is the trunk ID. 
+		TrunkKey key(make_pair(thr_trace[i], thr_trace[i + 1]), call_stack);
+		map<TrunkKey, TrunkMemo>::iterator it = trunk_cache.find(key);
+		if (it != trunk_cache.end()) {
+			++n_reused;
+			trunks.push_back(it->second.trunk);
+			call_stack = it->second.end_call_stack;
+			continue;
+		}
+		trunks.push_back(TrunkCFG());
+		compute_cfg_of_trunk(thr_trace[i], thr_trace[i + 1], call_stack,
+				trunks.back());
+		TrunkMemo &memo = trunk_cache[key];
+		memo.trunk = trunks.back();
+		memo.end_call_stack = call_stack;
+	}
+	return n_reused;
+}
+
+void MaxSlicing::build_cfg_of_thread(Module &M, int thr_id,
+		const vector<TrunkCFG> &trunks) {
+	dbgs() << "Building CFG of Thread " << thr_id << "...\n";
+	
+	clone_map[thr_id].clear();
+	assert(trace.count(thr_id));
+	const InstList &thr_trace = trace.find(thr_id)->second;
+	assert(thr_trace.size() > 0);
+	assert(trunks.size() + 1 == thr_trace.size());
 	if (thr_trace.size() == 1) {
 		Instruction *the_ins = thr_trace[0];
 		create_and_link_cloned_inst(thr_id, 0, the_ins);
 	} else {
-		// Iterate through each trunk except the last one. 
-		// The last instruction is automatically added when processing the
-		// second-to-last trunk. 
-		for (size_t i = 0, E = thr_trace.size(); i + 1 < E; ++i) {
-			dbgs() << "Building CFG of Trunk " << i << "...\n";
-			DEBUG(dbgs() << "  " << *thr_trace[i] << "\n";
-			dbgs() << "  " << *thr_trace[i + 1] << "\n";
-			print_call_stack(dbgs(), call_stack););
-			// <i> is the trunk ID. 
-			build_cfg_of_trunk(thr_trace[i], thr_trace[i + 1],
-					thr_id, i, call_stack);
+		for (size_t i = 0; i < trunks.size(); ++i) {
+			build_cfg_of_trunk(thr_trace[i], thr_trace[i + 1], thr_id, i,
+					trunks[i]);
 		}
 	}
-
-	DEBUG(dump_thr_cfg(cfg, thr_id););
-	// Assign containers. 
-	assert(!thr_trace.empty());
-	assert(clone_map[thr_id].size() > 0);
-	Instruction *start = clone_map[thr_id][0].lookup(thr_trace[0]);
-	assert(start);
-	assign_containers(M, start);
 }
 
 void MaxSlicing::print_call_stack(raw_ostream &O, const InstList &cs) {
@@ -369,8 +525,8 @@ void MaxSlicing::print_call_stack(raw_ostream &O, const InstList &cs) {
 		O << "  " << *cs[i] << "\n";
 }
 
-void MaxSlicing::build_cfg_of_trunk(Instruction *start, Instruction *end,
-		int thr_id, size_t trunk_id, InstList &call_stack) {
+void MaxSlicing::compute_cfg_of_trunk(Instruction *start, Instruction *end,
+		InstList &call_stack, TrunkCFG &trunk) {
 	assert(landmarks.count(end));
 
 	IDManager &IDM = getAnalysis<IDManager>();
@@ -406,11 +562,81 @@ void MaxSlicing::build_cfg_of_trunk(Instruction *start, Instruction *end,
 	assert(end_call_stack.empty() || end_call_stack.front() != NULL);
 
 	refine_from_end(start, end, visited_nodes, visited_edges);
+
+	DEBUG(print_inst_set(dbgs(), visited_nodes););
+	DEBUG(print_edge_set(dbgs(), visited_edges););
+
+	vector<pair<unsigned, Instruction *> > nodes;
+	forall(InstSet, it, visited_nodes)
+		nodes.push_back(make_pair(IDM.getInstructionID(*it), *it));
+	sort(nodes.begin(), nodes.end());
+	trunk.nodes.clear();
+	for (size_t i = 0; i < nodes.size(); ++i)
+		trunk.nodes.push_back(nodes[i].second);
+
+	vector<pair<pair<unsigned, unsigned>, Edge> > edges;
+	forall(EdgeSet, it, visited_edges) {
+		edges.push_back(make_pair(make_pair(
+						IDM.getInstructionID(it->first),
+						IDM.getInstructionID(it->second)), *it));
+	}
+	sort(edges.begin(), edges.end());
+	trunk.edges.clear();
+	for (size_t i = 0; i < edges.size(); ++i)
+		trunk.edges.push_back(edges[i].second);
+}
+
+void MaxSlicing::encode_trunk_cfgs(const vector<TrunkCFG> &trunks,
+		vector<unsigned> &ids) {
+	IDManager &IDM = getAnalysis<IDManager>();
+	// For each trunk: # of nodes, the nodes, # of edges, the edges. 
+	ids.clear();
+	for (size_t i = 0; i < trunks.size(); ++i) {
+		const TrunkCFG &trunk = trunks[i];
+		ids.push_back(trunk.nodes.size());
+		for (size_t j = 0; j < trunk.nodes.size(); ++j)
+			ids.push_back(IDM.getInstructionID(trunk.nodes[j]));
+		ids.push_back(trunk.edges.size());
+		for (size_t j = 0; j < trunk.edges.size(); ++j) {
+			ids.push_back(IDM.getInstructionID(trunk.edges[j].first));
+			ids.push_back(IDM.getInstructionID(trunk.edges[j].second));
+		}
+	}
+}
+
+void MaxSlicing::decode_trunk_cfgs(const vector<unsigned> &ids,
+		vector<TrunkCFG> &trunks) {
+	IDManager &IDM = getAnalysis<IDManager>();
+	trunks.clear();
+	size_t k = 0;
+	while (k < ids.size()) {
+		trunks.push_back(TrunkCFG());
+		TrunkCFG &trunk = trunks.back();
+		unsigned n_nodes = ids[k++];
+		for (unsigned j = 0; j < n_nodes; ++j) {
+			assert(k < ids.size());
+			trunk.nodes.push_back(IDM.getInstruction(ids[k++]));
+			assert(trunk.nodes.back());
+		}
+		assert(k < ids.size());
+		unsigned n_edges = ids[k++];
+		for (unsigned j = 0; j < n_edges; ++j) {
+			assert(k + 1 < ids.size());
+			Instruction *x = IDM.getInstruction(ids[k++]);
+			Instruction *y = IDM.getInstruction(ids[k++]);
+			assert(x && y);
+			trunk.edges.push_back(make_pair(x, y));
+		}
+	}
+}
+
+void MaxSlicing::build_cfg_of_trunk(Instruction *start, Instruction *end,
+		int thr_id, size_t trunk_id, const TrunkCFG &trunk) {
 	// Clone instructions in this trunk. 
 	// Note <start> may equal <end>. 
 	clone_map[thr_id].push_back(InstMapping());
-	forall(InstSet, it, visited_nodes) {
-		Instruction *orig = *it;
+	for (size_t i = 0; i < trunk.nodes.size(); ++i) {
+		Instruction *orig = trunk.nodes[i];
 		// <start> should be already cloned in the last trunk
 		// except for the first trunk. 
 		// <end> should be cloned into the next trunk. 
@@ -420,14 +646,11 @@ void MaxSlicing::build_cfg_of_trunk(Instruction *start, Instruction *end,
 	// <end> belongs to the next trunk. 
 	create_and_link_cloned_inst(thr_id, trunk_id + 1, end);
 
-	DEBUG(print_inst_set(dbgs(), visited_nodes););
-	DEBUG(print_edge_set(dbgs(), visited_edges););
-	
 	// Add this trunk to the CFG. 
-	forall(EdgeSet, it, visited_edges) {
+	for (size_t i = 0; i < trunk.edges.size(); ++i) {
 		Instruction *x, *y, *x1, *y1;
-		x = it->first;
-		y = it->second;
+		x = trunk.edges[i].first;
+		y = trunk.edges[i].second;
 		x1 = clone_map[thr_id][trunk_id].lookup(x);
 		if (!x1)
 			x->dump();
@@ -450,6 +673,7 @@ void MaxSlicing::create_and_link_cloned_inst(
 		clone_map[thr_id].push_back(InstMapping());
 	clone_map[thr_id][trunk_id][orig] = cloned;
 	clone_map_r[cloned] = orig;
+	cfg.add_node(cloned);
 	cloned_to_trunk[cloned] = trunk_id;
 	cloned_to_tid[cloned] = thr_id;
 }
@@ -488,25 +712,27 @@ void MaxSlicing::dfs_cfg(const CFG &cfg, Instruction *x,
 		InstSet &visited_nodes, EdgeSet &visited_edges) {
 	assert(x && "<x> cannot be NULL");
 	assert(visited_nodes.count(x) && "<x>'s parent hasn't been set");
-	const InstList &next_insts = cfg.lookup(x);
-	for (size_t j = 0, E = next_insts.size(); j < E; ++j) {
-		Instruction *y = next_insts[j];
-		visited_edges.insert(make_pair(x, y));
-		if (!visited_nodes.count(y)) {
-			// Has not visited <y>. 
-			visited_nodes.insert(y);
-			if (!landmarks.count(y))
-				dfs_cfg(cfg, y, visited_nodes, visited_edges);
+	// Iterative. The visiting order doesn't matter here. 
+	InstList stack(1, x);
+	while (!stack.empty()) {
+		x = stack.back();
+		stack.pop_back();
+		const InstList &next_insts = cfg.lookup(x);
+		for (size_t j = 0, E = next_insts.size(); j < E; ++j) {
+			Instruction *y = next_insts[j];
+			visited_edges.insert(make_pair(x, y));
+			if (!visited_nodes.count(y)) {
+				// Has not visited <y>. 
+				visited_nodes.insert(y);
+				if (!landmarks.count(y))
+					stack.push_back(y);
+			}
 		}
 	}
 }
 
-void MaxSlicing::dfs(Instruction *x, Instruction *end,
-		InstSet &visited_nodes, EdgeSet &visited_edges,
-		InstList &call_stack, InstList &end_call_stack) {
-	assert(x && "<x> cannot be NULL");
-	assert(visited_nodes.count(x));
-
+void MaxSlicing::enter_dfs_frame(DFSFrame &frame, InstList &call_stack) {
+	Instruction *x = frame.x;
 	DEBUG(dbgs() << "dfs:" << *x << "\n";);
 	DEBUG(print_call_stack(dbgs(), call_stack););
 
@@ -528,14 +754,10 @@ void MaxSlicing::dfs(Instruction *x, Instruction *end,
 			for (size_t j = 0, E = callees.size(); j < E; ++j) {
 				if (callees[j]->isDeclaration())
 					continue;
-				Instruction *y = callees[j]->getEntryBlock().begin();
-				call_stack.push_back(x);
-				move_on(x, y, end,
-						visited_nodes, visited_edges,
-						call_stack, end_call_stack);
-				assert(call_stack.back() == x);
-				call_stack.pop_back();
+				frame.succs.push_back(callees[j]->getEntryBlock().begin());
 			}
+			frame.is_call = true;
+			call_stack.push_back(x);
 			return;
 		}
 		// If the callee cannot execute any landmark,
@@ -558,34 +780,63 @@ void MaxSlicing::dfs(Instruction *x, Instruction *end,
 		} else {
 			assert(false && "Only CallInsts and InvokeInsts can call functions");
 		}
-		Instruction *bkp = call_stack.back();
+		frame.succs.push_back(y);
+		frame.ret_addr = call_stack.back();
 		call_stack.pop_back();
-		move_on(x, y, end,
-				visited_nodes, visited_edges,
-				call_stack, end_call_stack);
-		call_stack.push_back(bkp);
 		return;
 	} // if is_ret
 
 	if (!x->isTerminator()) {
 		BasicBlock::iterator y = x; ++y;
-		move_on(x, y, end,
-				visited_nodes, visited_edges,
-				call_stack, end_call_stack);
+		frame.succs.push_back(y);
 	} else {
 		TerminatorInst *ti = dyn_cast<TerminatorInst>(x);
-		for (unsigned j = 0, E = ti->getNumSuccessors(); j < E; ++j) {
-			Instruction *y = ti->getSuccessor(j)->begin();
-			move_on(x, y, end,
-					visited_nodes, visited_edges,
-					call_stack, end_call_stack);
-		}
+		for (unsigned j = 0, E = ti->getNumSuccessors(); j < E; ++j)
+			frame.succs.push_back(ti->getSuccessor(j)->begin());
 	}
 }
 
-void MaxSlicing::move_on(Instruction *x, Instruction *y, Instruction *end,
+void MaxSlicing::dfs(Instruction *x, Instruction *end,
 		InstSet &visited_nodes, EdgeSet &visited_edges,
 		InstList &call_stack, InstList &end_call_stack) {
+	assert(x && "<x> cannot be NULL");
+	assert(visited_nodes.count(x));
+
+	/*
+	 * Visits the instructions in the same order as a recursive DFS would,
+	 * because an instruction is visited only under the first call stack
+	 * reaching it. 
+	 */
+	vector<DFSFrame> stack;
+	stack.push_back(DFSFrame(x));
+	enter_dfs_frame(stack.back(), call_stack);
+	while (!stack.empty()) {
+		DFSFrame &frame = stack.back();
+		if (frame.next == frame.succs.size()) {
+			// Leave the frame. Restore the call stack. 
+			if (frame.is_call) {
+				assert(call_stack.back() == frame.x);
+				call_stack.pop_back();
+			}
+			if (frame.ret_addr)
+				call_stack.push_back(frame.ret_addr);
+			stack.pop_back();
+			continue;
+		}
+		Instruction *x = frame.x, *y = frame.succs[frame.next];
+		++frame.next;
+		if (move_on(x, y, end, visited_nodes, visited_edges,
+					call_stack, end_call_stack)) {
+			// <frame> is invalidated. 
+			stack.push_back(DFSFrame(y));
+			enter_dfs_frame(stack.back(), call_stack);
+		}
+	}
+}
+
+bool MaxSlicing::move_on(Instruction *x, Instruction *y, Instruction *end,
+		InstSet &visited_nodes, EdgeSet &visited_edges,
+		const InstList &call_stack, InstList &end_call_stack) {
 	DEBUG(dbgs() << "move_on:" << *y << "\n";);
 	/*
 	 * No matter whether <y> is in the cut, we mark <y> and <x, y>
@@ -605,9 +856,9 @@ void MaxSlicing::move_on(Instruction *x, Instruction *y, Instruction *end,
 	}
 	if (!visited_nodes.count(y)) {
 		visited_nodes.insert(y);
-		if (!landmarks.count(y))
-			dfs(y, end, visited_nodes, visited_edges, call_stack, end_call_stack);
+		return !landmarks.count(y);
 	}
+	return false;
 }
 
 bool MaxSlicing::is_sliced(const Function *f) {
@@ -642,7 +893,7 @@ void MaxSlicing::find_invoke_successors_from(Module &M, Instruction *start) {
 	while (!q.empty()) {
 		Instruction *x = q.front().first;
 		const InstList &call_stack = q.front().second;
-		const InstList &next_insts = cfg.lookup(x);
+		ArrayRef<Instruction *> next_insts = cfg.successors(x);
 		for (size_t j = 0, E = next_insts.size(); j < E; ++j) {
 			Instruction *y = next_insts[j];
 			if (visited.count(y))
@@ -47,7 +47,7 @@ void MaxSlicing::fix_def_use_phinodes(BasicBlock *bi) {
 
 	// Fix all PHINodes in this BB. 
 	BBMapping actual_pred_bbs;
-	const InstList &actual_pred_insts = cfg_r.lookup(bi->begin());
+	ArrayRef<Instruction *> actual_pred_insts = cfg.predecessors(bi->begin());
 	for (size_t j = 0; j < actual_pred_insts.size(); ++j) {
 		Instruction *actual_pred_inst = actual_pred_insts[j];
 		EdgeType et = get_edge_type(actual_pred_inst, bi->begin());
@@ -139,7 +139,7 @@ void MaxSlicing::fix_def_use_terminator(BasicBlock *bb,
 		if (invoke_successors.count(ti))
 			actual_succ_insts = invoke_successors.lookup(ti);
 		else
-			actual_succ_insts = cfg.lookup(ti);
+			actual_succ_insts = cfg.successors(ti).vec();
 
 		for (size_t j = 0; j < actual_succ_insts.size(); ++j) {
 			Instruction *orig_succ_inst =
@@ -244,7 +244,7 @@ void MaxSlicing::fix_def_use_func_call(Module &M) {
 	forall(InstMapping, it, clone_map_r) {
 		Instruction *ins = it->first;
 		if (is_call(ins) && !is_intrinsic_call(ins)) {
-			const InstList &next_insts = cfg.lookup(ins);
+			ArrayRef<Instruction *> next_insts = cfg.successors(ins);
 			Function *callee = NULL;
 			for (size_t j = 0; j < next_insts.size(); ++j) {
 				if (get_edge_type(ins, next_insts[j]) == EDGE_CALL) {
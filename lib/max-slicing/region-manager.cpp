@@ -53,6 +53,13 @@ bool RegionManager::runOnModule(Module &M) {
 	LandmarkTrace &LT = getAnalysis<LandmarkTrace>();
 	ExecOnce &EO = getAnalysis<ExecOnce>();
 
+	index_regions();
+	ins_ids.clear();
+	ins_region.clear();
+	id_to_ins.clear();
+	region_insts.assign(all_regions.size(), SparseBitVector<>());
+	func_regions.clear();
+
 	if (!CIM.has_clone_info()) {
 		errs() << "[Warning] The program doesn't contain any clone_info, "
 			<< "therefore RegionManager gives up marking region info.\n";
@@ -88,7 +95,7 @@ bool RegionManager::runOnModule(Module &M) {
 		// Skip unreachable instructions. 
 		if (EO.not_executed(ins))
 			continue;
-		if (!ins_region.count(ins)) {
+		if (!ins_ids.count(ins)) {
 			BasicBlock *bb = ins->getParent();
 			Function *f = bb->getParent();
 			if (!(MaxSlicing::is_unreachable(bb) || !MaxSlicing::is_sliced(f)))
@@ -100,6 +107,40 @@ bool RegionManager::runOnModule(Module &M) {
 	return false;
 }
 
+void RegionManager::index_regions() {
+	LandmarkTrace &LT = getAnalysis<LandmarkTrace>();
+
+	thread_regions.clear();
+	all_regions.clear();
+	region_ids.clear();
+	vector<int> thr_ids = LT.get_thr_ids();
+	for (size_t k = 0; k < thr_ids.size(); ++k) {
+		int i = thr_ids[k];
+		ThreadRegions &tr = thread_regions[i];
+		size_t n_trunks = LT.get_n_trunks(i);
+		size_t prev_trunk_id = (size_t)-1;
+		unsigned prev_timestamp = -1;
+		for (size_t j = 0; j < n_trunks; ++j) {
+			if (LT.is_enforcing_landmark(i, j)) {
+				unsigned timestamp = LT.get_landmark_timestamp(i, j);
+				assert(prev_trunk_id == (size_t)-1 || prev_timestamp < timestamp);
+				tr.regions.push_back(Region(i, prev_trunk_id, j));
+				tr.starts.push_back(prev_timestamp);
+				tr.ends.push_back(timestamp);
+				prev_trunk_id = j;
+				prev_timestamp = timestamp;
+			}
+		}
+		tr.regions.push_back(Region(i, prev_trunk_id, (size_t)-1));
+		tr.starts.push_back(prev_timestamp);
+		tr.ends.push_back(-1);
+		for (size_t j = 0; j < tr.regions.size(); ++j) {
+			region_ids[tr.regions[j]] = all_regions.size();
+			all_regions.push_back(tr.regions[j]);
+		}
+	}
+}
+
 void RegionManager::mark_region(
 		const InstList &s_insts, const InstList &e_insts,
 		int thr_id, size_t s_tr, size_t e_tr) {
@@ -188,6 +229,9 @@ void RegionManager::mark_region(
 	}
 
 	DEBUG(dbgs() << "# of visited MBBs = " << visited.size() << "\n";);
+	Region r(thr_id, s_tr, e_tr);
+	assert(region_ids.count(r));
+	unsigned region_id = region_ids.lookup(r);
 	assert(!visited.count(fake_root) &&
 			"The fake root should have been removed.");
 #if 0
@@ -232,15 +276,21 @@ void RegionManager::mark_region(
 				continue;
 			// An instruction in the unreachable BB can be contained in multiple 
 			// regions actually. 
-			if (ins_region.count(i)) {
+			if (ins_ids.count(i)) {
 				errs() << *i << "\n";
-				errs() << "already appeared in " << ins_region.find(i)->second << "\n";
+				errs() << "already appeared in " <<
+					all_regions[ins_region[ins_ids.lookup(i)]] << "\n";
 			}
-			assert(!ins_region.count(i));
+			assert(!ins_ids.count(i));
 #endif
-			Region r(thr_id, s_tr, e_tr);
-			ins_region.insert(make_pair(i, r));
-			region_insts[r].push_back(i);
+			const Instruction *ins = i;
+			DenseMap<const Instruction *, unsigned>::iterator it = ins_ids.find(ins);
+			if (it == ins_ids.end()) {
+				it = ins_ids.insert(make_pair(ins, (unsigned)id_to_ins.size())).first;
+				id_to_ins.push_back(ins);
+				ins_region.push_back(region_id);
+			}
+			region_insts[region_id].set(it->second);
 		}
 	}
 }
@@ -248,15 +298,31 @@ void RegionManager::mark_region(
 void RegionManager::get_containing_regions(
 		const Instruction *ins, vector<Region> &regions) const {
 	regions.clear();
-	ConstInstSet visited;
-	search_containing_regions(ins, visited, regions);
-	sort(regions.begin(), regions.end());
-	regions.erase(unique(regions.begin(), regions.end()), regions.end());
+	DenseMap<const Instruction *, unsigned>::const_iterator it =
+		ins_ids.find(ins);
+	if (it != ins_ids.end()) {
+		regions.push_back(all_regions[ins_region[it->second]]);
+		return;
+	}
+
+	// <ins> is outside the sliced part. Its containing regions are those of
+	// the callers of its function. 
+	const Function *f = ins->getParent()->getParent();
+	if (!func_regions.count(f)) {
+		SparseBitVector<> region_set;
+		ConstInstSet visited;
+		search_containing_regions(ins, visited, region_set);
+		func_regions[f] = region_set;
+	}
+	const SparseBitVector<> &region_set = func_regions.find(f)->second;
+	for (SparseBitVector<>::iterator j = region_set.begin();
+			j != region_set.end(); ++j)
+		regions.push_back(all_regions[*j]);
 }
 
 void RegionManager::search_containing_regions(
 		const Instruction *ins, ConstInstSet &visited,
-		vector<Region> &regions) const {
+		SparseBitVector<> &region_set) const {
 	
 	if (visited.count(ins))
 		return;
@@ -266,8 +332,10 @@ void RegionManager::search_containing_regions(
 	 * If <ins> is in the sliced part, we take the region info right away. 
 	 * Otherwise, we trace back to the caller(s) of the containing function. 
 	 */
-	if (ins_region.count(ins)) {
-		regions.push_back(ins_region.find(ins)->second);
+	DenseMap<const Instruction *, unsigned>::const_iterator it =
+		ins_ids.find(ins);
+	if (it != ins_ids.end()) {
+		region_set.set(ins_region[it->second]);
 		return;
 	}
 	
@@ -277,7 +345,7 @@ void RegionManager::search_containing_regions(
 	InstList call_sites = CG.getCallSites(f);
 	forall(InstList, it, call_sites) {
 		if (!is_pthread_create(*it))
-			search_containing_regions(*it, visited, regions);
+			search_containing_regions(*it, visited, region_set);
 	}
 }
 
@@ -318,25 +386,36 @@ void RegionManager::get_concurrent_regions(
 	
 	LandmarkTrace &LT = getAnalysis<LandmarkTrace>();
 
-	// TODO: This step can be faster by using binary searching. 
-	vector<int> thr_ids = LT.get_thr_ids();
-	for (size_t i = 0; i < thr_ids.size(); ++i) {
-		int thr_id = thr_ids[i];
-		if (thr_id == r.thr_id)
+	unsigned a1 = (r.prev_enforcing_landmark == (size_t)-1 ? -1 :
+			LT.get_landmark_timestamp(r.thr_id, r.prev_enforcing_landmark));
+	unsigned a2 = (r.next_enforcing_landmark == (size_t)-1 ? -1 :
+			LT.get_landmark_timestamp(r.thr_id, r.next_enforcing_landmark));
+
+	/*
+	 * The regions of each thread are sorted by timestamps, so the regions
+	 * concurrent with [a1, a2] are contiguous: those ending after <a1> and
+	 * starting before <a2>. See <concurrent>. 
+	 */
+	for (map<int, ThreadRegions>::const_iterator it = thread_regions.begin();
+			it != thread_regions.end(); ++it) {
+		if (it->first == r.thr_id)
 			continue;
-		const vector<LandmarkTraceRecord> &thr_trunks = LT.get_thr_trunks(thr_id);
-		size_t prev_trunk_id = (size_t)-1;
-		for (size_t j = 0; j < thr_trunks.size(); ++j) {
-			if (LT.is_enforcing_landmark(i, j)) {
-				Region cur(thr_id, prev_trunk_id, j);
-				if (concurrent(r, cur))
-					regions.push_back(cur);
-				prev_trunk_id = j;
-			}
+		const ThreadRegions &tr = it->second;
+		size_t n = tr.regions.size();
+		// The first region with end > a1. 
+		size_t lo = 0;
+		if (a1 != (unsigned)-1) {
+			lo = upper_bound(tr.ends.begin(), tr.ends.end(), a1) -
+				tr.ends.begin();
+		}
+		// One past the last region with start < a2. 
+		size_t hi = n;
+		if (a2 != (unsigned)-1) {
+			hi = lower_bound(tr.starts.begin() + 1, tr.starts.end(), a2) -
+				tr.starts.begin();
 		}
-		Region last(thr_id, prev_trunk_id, (size_t)-1);
-		if (concurrent(r, last))
-			regions.push_back(last);
+		for (size_t k = lo; k < hi; ++k)
+			regions.push_back(tr.regions[k]);
 	}
 }
 
@@ -426,12 +505,17 @@ Region RegionManager::next_region(const Region &r) const {
 }
 
 bool RegionManager::region_has_insts(const Region &r) const {
-	return region_insts.count(r);
+	DenseMap<Region, unsigned>::const_iterator it = region_ids.find(r);
+	return it != region_ids.end() && !region_insts[it->second].empty();
 }
 
-const ConstInstList &RegionManager::get_insts_in_region(const Region &r) const {
+void RegionManager::get_insts_in_region(const Region &r,
+		ConstInstList &insts) const {
 	assert(region_has_insts(r));
-	return region_insts.find(r)->second;
+	insts.clear();
+	const SparseBitVector<> &row = region_insts[region_ids.lookup(r)];
+	for (SparseBitVector<>::iterator j = row.begin(); j != row.end(); ++j)
+		insts.push_back(id_to_ins[*j]);
 }
 
 void RegionManager::print(raw_ostream &O, const Module *M) const {
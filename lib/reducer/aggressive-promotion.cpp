@@ -121,12 +121,11 @@ bool AggressivePromotion::loop_may_write(const Loop *L, const Value *p) {
 	MayWriteAnalyzer &MWA = getAnalysis<MayWriteAnalyzer>();
 	assert(getAnalysisIfAvailable<AdvancedAlias>() == NULL);
 
-	ConstFuncSet visited_funcs;
 	// Loops over all BBs in this loop and its subloops. 
 	for (Loop::block_iterator bi = L->block_begin(); bi != L->block_end(); ++bi) {
 		BasicBlock *bb = *bi;
 		for (BasicBlock::iterator ins = bb->begin(); ins != bb->end(); ++ins) {
-			if (MWA.may_write(ins, p, visited_funcs))
+			if (MWA.may_write(ins, p))
 				return true;
 		}
 	}
@@ -0,0 +1,96 @@
+/**
+ * Author: Jingyue
+ */
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <locale>
+using namespace std;
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+using namespace llvm;
+
+#include "slicer/analysis-cache.h"
+using namespace slicer;
+
+static cl::opt<string> AnalysisCacheDir("analysis-cache-dir",
+		cl::desc("The directory that persists trace-independent analysis "
+			"results across runs on the same bitcode"),
+		cl::init(""));
+
+bool AnalysisCache::enabled() {
+	return AnalysisCacheDir != "";
+}
+
+long AnalysisCache::hash_string(const string &str) {
+	locale loc;
+	const collate<char> &coll = use_facet<collate<char> >(loc);
+	return coll.hash(str.data(), str.data() + str.length());
+}
+
+long AnalysisCache::hash_module(const Module &M) {
+	string str;
+	raw_string_ostream oss(str);
+	M.print(oss, NULL);
+	return hash_string(oss.str());
+}
+
+string AnalysisCache::get_file_name(long module_hash,
+		const string &pass_name, const string &options) {
+	assert(enabled());
+	string file_name;
+	raw_string_ostream oss(file_name);
+	oss << AnalysisCacheDir << "/" << pass_name << ".";
+	oss.write_hex((unsigned long)module_hash);
+	oss << ".";
+	oss.write_hex((unsigned long)hash_string(options));
+	return oss.str();
+}
+
+/*
+ * File format:
+ * <# of unsigneds>
+ * <unsigned> <unsigned> ...
+ */
+bool AnalysisCache::load(const string &file_name, vector<unsigned> &data) {
+	data.clear();
+	ifstream fin(file_name.c_str());
+	if (!fin)
+		return false;
+	size_t n;
+	if (!(fin >> n))
+		return false;
+	data.reserve(n);
+	unsigned x;
+	while (data.size() < n && fin >> x)
+		data.push_back(x);
+	if (data.size() < n) {
+		data.clear();
+		return false;
+	}
+	return true;
+}
+
+bool AnalysisCache::save(const string &file_name,
+		const vector<unsigned> &data) {
+	string tmp_file_name;
+	raw_string_ostream oss(tmp_file_name);
+	oss << file_name << ".tmp." << getpid();
+	oss.flush();
+
+	ofstream fout(tmp_file_name.c_str());
+	if (!fout)
+		return false;
+	fout << data.size() << "\n";
+	for (size_t i = 0; i < data.size(); ++i)
+		fout << data[i] << (i + 1 == data.size() || (i + 1) % 16 == 0 ? "\n" : " ");
+	fout.close();
+	if (!fout || rename(tmp_file_name.c_str(), file_name.c_str()) != 0) {
+		remove(tmp_file_name.c_str());
+		return false;
+	}
+	return true;
+}
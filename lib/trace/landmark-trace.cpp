@@ -5,6 +5,7 @@
 #define DEBUG_TYPE "trace"
 
 #include <fstream>
+#include <algorithm>
 using namespace std;
 
 #include "llvm/Support/CommandLine.h"
@@ -35,12 +36,8 @@ void LandmarkTrace::getAnalysisUsage(AnalysisUsage &AU) const {
 
 LandmarkTrace::LandmarkTrace(): ModulePass(ID) {}
 
-vector<int> LandmarkTrace::get_thr_ids() const {
-	map<int, vector<LandmarkTraceRecord> >::const_iterator it;
-	vector<int> res;
-	for (it = thread_trunks.begin(); it != thread_trunks.end(); ++it)
-		res.push_back(it->first);
-	return res;
+const vector<int> &LandmarkTrace::get_thr_ids() const {
+	return thr_ids;
 }
 
 bool LandmarkTrace::runOnModule(Module &M) {
@@ -48,6 +45,7 @@ bool LandmarkTrace::runOnModule(Module &M) {
 	ifstream fin(LandmarkTraceFile.c_str(), ios::in | ios::binary);
 	assert(fin && "Cannot open the input landmark trace file");
 	LandmarkTraceRecord record;
+	map<int, vector<LandmarkTraceRecord> > thread_trunks;
 	while (fin.read((char *)&record, sizeof record)) {
 		thread_trunks[record.tid].push_back(record);
 		if (record.enforcing)
@@ -56,9 +54,71 @@ bool LandmarkTrace::runOnModule(Module &M) {
 			++NumDerivedEvents;
 	}
 
+	// Give each thread a dense index in the order of thread IDs. 
+	thr_ids.clear();
+	thr_indices.clear();
+	threads.clear();
+	threads.resize(thread_trunks.size());
+	for (map<int, vector<LandmarkTraceRecord> >::iterator
+			it = thread_trunks.begin(); it != thread_trunks.end(); ++it) {
+		thr_indices[it->first] = thr_ids.size();
+		ThreadLandmarks &t = threads[thr_ids.size()];
+		thr_ids.push_back(it->first);
+		t.trunks.swap(it->second);
+		index_thread(t);
+	}
+
 	return false;
 }
 
+void LandmarkTrace::index_thread(ThreadLandmarks &t) {
+	size_t n = t.trunks.size();
+	t.timestamps.resize(n);
+	for (size_t j = 0; j < n; ++j) {
+		t.timestamps[j] = t.trunks[j].idx;
+		assert((j == 0 || t.timestamps[j - 1] < t.timestamps[j]) &&
+				"Landmarks in a thread should be sorted by timestamps");
+	}
+
+	// The same as what <extend_until_enforce> used to compute by scanning. 
+	t.region_starts.resize(n);
+	for (size_t j = 0; j < n; ++j) {
+		t.region_starts[j] = (j == 0 || t.trunks[j].enforcing ?
+				j : t.region_starts[j - 1]);
+	}
+	t.region_ends.resize(n);
+	for (size_t j = n; j > 0; --j) {
+		size_t e = j - 1;
+		t.region_ends[e] = (e + 1 == n || t.trunks[e + 1].enforcing ?
+				e : t.region_ends[e + 1]);
+	}
+
+	t.bucket_shift = 0;
+	t.bucket_starts.clear();
+	if (n == 0)
+		return;
+	// The smallest bucket size that gives no more buckets than landmarks. 
+	unsigned last = t.timestamps.back();
+	while (t.bucket_shift < 31 && (last >> t.bucket_shift) + 1 > n)
+		++t.bucket_shift;
+	size_t n_buckets = (last >> t.bucket_shift) + 1;
+	t.bucket_starts.resize(n_buckets + 1);
+	size_t j = 0;
+	for (size_t b = 0; b < n_buckets; ++b) {
+		while (j < n && (t.timestamps[j] >> t.bucket_shift) < b)
+			++j;
+		t.bucket_starts[b] = j;
+	}
+	t.bucket_starts[n_buckets] = n;
+}
+
+const LandmarkTrace::ThreadLandmarks &LandmarkTrace::get_thread(
+		int thr_id) const {
+	DenseMap<int, unsigned>::const_iterator it = thr_indices.find(thr_id);
+	assert(it != thr_indices.end());
+	return threads[it->second];
+}
+
 void LandmarkTrace::print(raw_ostream &O, const Module *M) const {
 }
 
@@ -68,7 +128,9 @@ size_t LandmarkTrace::get_n_trunks(int thr_id) const {
 
 unsigned LandmarkTrace::get_landmark_timestamp(
 		int thr_id, size_t trunk_id)	const {
-	return get_landmark(thr_id, trunk_id).idx;
+	const vector<unsigned> &timestamps = get_thread(thr_id).timestamps;
+	assert(trunk_id < timestamps.size());
+	return timestamps[trunk_id];
 }
 
 const LandmarkTraceRecord &LandmarkTrace::get_landmark(
@@ -87,18 +149,9 @@ void LandmarkTrace::extend_until_enforce(
 		errs() << "trunk id = " << e << "\n";
 	}
 	assert(e < get_n_trunks(thr_id));
-	while (s > 0) {
-		if (is_enforcing_landmark(thr_id, s))
-			break;
-		--s;
-	}
-	// If e + 1 == get_n_trunks(thr_id), then e is already the last trunk. 
-	while (e + 1 < get_n_trunks(thr_id)) {
-		size_t e1 = e + 1;
-		if (is_enforcing_landmark(thr_id, e1))
-			break;
-		e = e1;
-	}
+	const ThreadLandmarks &t = get_thread(thr_id);
+	s = t.region_starts[s];
+	e = t.region_ends[e];
 }
 
 void LandmarkTrace::get_concurrent_regions(const pair<int, size_t> &the_trunk,
@@ -108,7 +161,6 @@ void LandmarkTrace::get_concurrent_regions(const pair<int, size_t> &the_trunk,
 	unsigned s_idx = get_landmark_timestamp(the_trunk.first, s);
 	unsigned e_idx = get_landmark_timestamp(the_trunk.first,
 			(e + 1 == get_n_trunks(the_trunk.first) ? e : e + 1));
-	vector<int> thr_ids = get_thr_ids();
 	for (size_t i = 0; i < thr_ids.size(); ++i) {
 		int thr_id = thr_ids[i];
 		// Look at other threads only. 
@@ -205,24 +257,22 @@ bool LandmarkTrace::happens_before(int i1, size_t j1, int i2, size_t j2) const {
 
 const vector<LandmarkTraceRecord> &LandmarkTrace::get_thr_trunks(
 		int thr_id) const {
-	assert(thread_trunks.count(thr_id));
-	return thread_trunks.find(thr_id)->second;
+	return get_thread(thr_id).trunks;
 }
 
-// Find the first index >= <idx>. 
+// Find the first index >= <idx>, i.e. the number of landmarks < <idx>. 
 // <, <, <, >=, >=
 size_t LandmarkTrace::search_landmark_in_thread(int thr_id, unsigned idx) const {
-	const vector<LandmarkTraceRecord> &thr_trunks = get_thr_trunks(thr_id);
-	size_t low = 0, high = thr_trunks.size();
-	while (low < high) {
-		size_t mid = (low + high) / 2;
-		if (thr_trunks[mid].idx >= idx)
-			high = mid;
-		else
-			low = mid + 1;
-	}
-	assert(low == high);
-	return low;
+	const ThreadLandmarks &t = get_thread(thr_id);
+	size_t b = idx >> t.bucket_shift;
+	// Also covers threads without any landmark. 
+	if (b + 1 >= t.bucket_starts.size())
+		return t.trunks.size();
+	// Landmarks in earlier buckets are < <idx>, and the ones in later
+	// buckets are >= <idx>. 
+	return lower_bound(t.timestamps.begin() + t.bucket_starts[b],
+			t.timestamps.begin() + t.bucket_starts[b + 1], idx) -
+		t.timestamps.begin();
 }
 
 bool LandmarkTrace::is_enforcing_landmark(int thr_id, size_t trunk_id) const {
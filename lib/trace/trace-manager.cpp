@@ -2,18 +2,24 @@
  * Author: Jingyue
  */
 
+#include <algorithm>
+#include <functional>
 #include <fstream>
 #include <sstream>
 using namespace std;
 
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/system_error.h"
+#include "llvm/ADT/OwningPtr.h"
 using namespace llvm;
 
 #include "rcs/IDManager.h"
 using namespace rcs;
 
 #include "slicer/trace-manager.h"
+#include "slicer/trace-format.h"
 using namespace slicer;
 
 static RegisterPass<TraceManager> X("trace-manager",
@@ -30,97 +36,263 @@ static cl::opt<string> FullTraceFile(
 
 char TraceManager::ID = 0;
 
-bool TraceManager::read_record(istream &fin,
-		TraceRecord &record) const {
-	assert((fin.flags() | ios::binary) && "Must be a binary stream");
-	if (fin.read((char *)&record, sizeof record))
-		return true;
-	else
-		return false;
-}
+TraceManager::TraceManager(): ModulePass(ID), n_records(0), n_threads(0),
+	cur_idx(INVALID_IDX) {}
 
-TraceManager::TraceManager(): ModulePass(ID), n_threads(0) {}
+void TraceManager::releaseMemory() {
+	trace_buffer.reset();
+	n_records = 0;
+	threads.clear();
+	runs.clear();
+	child_tids.clear();
+	raw_tid_to_tid.clear();
+	n_threads = 0;
+	cursors.clear();
+	heap.clear();
+	cur_idx = INVALID_IDX;
+}
 
 bool TraceManager::runOnModule(Module &M) {
-	records.clear();
+	releaseMemory();
 
 	string full_trace_file = FullTraceFile;
 	assert(full_trace_file != "" && "Didn't specify the full trace.");
-	ifstream fin(full_trace_file.c_str(), ios::in | ios::binary);
-	assert(fin && "Cannot open the full trace.");
-
-	TraceRecord record;
-	while (read_record(fin, record))
-		records.push_back(record);
-
-	compute_record_infos(M);
+	// Large files are mmap'ed instead of read. The records are decoded from
+	// the mapping on demand, so it's kept until releaseMemory. 
+	error_code ec = MemoryBuffer::getFile(full_trace_file, trace_buffer,
+			-1, false);
+	assert(!ec && "Cannot open the full trace.");
+	index_trace(trace_buffer->getBufferStart(), trace_buffer->getBufferSize());
 
 	validate_trace(M);
 
 	return false;
 }
 
-void TraceManager::validate_trace(Module &M) {
+namespace {
+	struct BlockCursor {
+		BlockCursor(const char *block): decoder(block), valid(true) {
+			advance();
+		}
+		void advance() {
+			p = decoder.p;
+			n_decoded = decoder.n_decoded;
+			prev_ins_id = decoder.prev_ins_id;
+			prev_timestamp = decoder.prev_timestamp;
+			valid = decoder.next(record);
+		}
+
+		TraceBlockDecoder decoder;
+		// The decoder state before decoding <record>. 
+		const char *p;
+		unsigned n_decoded, prev_ins_id, prev_timestamp;
+		TraceRecord record;
+		bool valid;
+	};
+
+	// Orders the cursors in a min-heap by their current timestamps. 
+	struct CompareCursors {
+		CompareCursors(const vector<BlockCursor> &c): cursors(c) {}
+		bool operator()(unsigned a, unsigned b) const {
+			unsigned ta = cursors[a].record.timestamp;
+			unsigned tb = cursors[b].record.timestamp;
+			// Break ties by the block order to be deterministic. 
+			return ta > tb || (ta == tb && a > b);
+		}
+		const vector<BlockCursor> &cursors;
+	};
 }
 
-void TraceManager::compute_record_infos(Module &M) {
-	if (records.empty())
-		return;
-	raw_tid_to_tid.clear();
-	n_threads = 0;
-	// Map the raw main thread ID to 0.
-	// Not necessary though, because the first record will be processed first.
-	// But for safety reason, we put it here. 
-	raw_tid_to_tid[records[0].raw_tid] = 0;
-	++n_threads;
-	for (size_t i = 0, E = records.size(); i < E; ++i) {
-		IDManager &IDM = getAnalysis<IDManager>();
-		TraceRecordInfo info;
-		info.ins = IDM.getInstruction(records[i].ins_id);
-		assert(info.ins);
-		info.tid = get_normalized_tid(records[i].raw_tid);
-		if (records[i].raw_child_tid == INVALID_RAW_TID) {
-			info.child_tid = INVALID_TID;
-		} else {
-			raw_tid_to_tid[records[i].raw_child_tid] = n_threads;
-			info.child_tid = n_threads;
+void TraceManager::index_trace(const char *start, size_t size) {
+	vector<const char *> blocks;
+	bool valid = index_trace_blocks(start, size, blocks);
+	assert(valid && "The full trace is corrupted or of an unknown version.");
+
+	vector<BlockCursor> block_cursors;
+	block_cursors.reserve(blocks.size());
+	for (size_t i = 0; i < blocks.size(); ++i)
+		block_cursors.push_back(BlockCursor(blocks[i]));
+	// The normalized thread of each block. 
+	vector<int> block_tids(blocks.size(), (int)INVALID_TID);
+
+	/*
+	 * Each block is sorted by timestamps. Merge the blocks of all threads
+	 * into the total order. 
+	 */
+	vector<unsigned> block_heap;
+	for (unsigned i = 0; i < block_cursors.size(); ++i) {
+		if (block_cursors[i].valid)
+			block_heap.push_back(i);
+	}
+	CompareCursors cmp(block_cursors);
+	make_heap(block_heap.begin(), block_heap.end(), cmp);
+	unsigned last_timestamp = 0;
+	while (!block_heap.empty()) {
+		pop_heap(block_heap.begin(), block_heap.end(), cmp);
+		unsigned b = block_heap.back();
+		BlockCursor &cursor = block_cursors[b];
+		const TraceRecord &record = cursor.record;
+		unsigned idx = n_records++;
+		assert(idx != INVALID_IDX && "Too many trace records");
+
+		// The first record is always from the main thread, so the main thread
+		// is normalized to 0. 
+		int tid = get_normalized_tid(record.raw_tid);
+		if (block_tids[b] == INVALID_TID) {
+			block_tids[b] = tid;
+			threads[tid].blocks.push_back(blocks[b]);
+		}
+		assert(block_tids[b] == tid && "A block holds the records of one thread");
+		if (cursor.n_decoded % CheckpointInterval == 0) {
+			Checkpoint cp;
+			cp.block = threads[tid].blocks.size() - 1;
+			cp.p = cursor.p;
+			cp.n_decoded = cursor.n_decoded;
+			cp.prev_ins_id = cursor.prev_ins_id;
+			cp.prev_timestamp = cursor.prev_timestamp;
+			cp.timestamp = record.timestamp;
+			threads[tid].checkpoints.push_back(cp);
+		}
+
+		assert((idx == 0 || record.timestamp > last_timestamp) &&
+				"Timestamps should be unique");
+		if (idx == 0 || record.timestamp != last_timestamp + 1)
+			runs.push_back(make_pair(idx, record.timestamp));
+		last_timestamp = record.timestamp;
+
+		if (record.raw_child_tid != INVALID_RAW_TID) {
+			raw_tid_to_tid[record.raw_child_tid] = n_threads;
+			child_tids[idx] = n_threads;
 			++n_threads;
+			threads.resize(n_threads);
 		}
-		record_infos.push_back(info);
+
+		cursor.advance();
+		if (cursor.valid)
+			push_heap(block_heap.begin(), block_heap.end(), cmp);
+		else
+			block_heap.pop_back();
 	}
-	assert(record_infos.size() == records.size());
+	cursors.resize(n_threads);
+}
+
+void TraceManager::validate_trace(Module &M) {
 }
 
 int TraceManager::get_normalized_tid(unsigned long raw_tid) {
 	assert(raw_tid != INVALID_RAW_TID);
 	if (!raw_tid_to_tid.count(raw_tid)) {
-		int new_thr_id = raw_tid_to_tid.size();
-		raw_tid_to_tid[raw_tid] = new_thr_id;
+		raw_tid_to_tid[raw_tid] = n_threads;
+		++n_threads;
+		threads.resize(n_threads);
 	}
 	return raw_tid_to_tid[raw_tid];
 }
 
 unsigned TraceManager::get_num_records() const {
-	return records.size();
+	return n_records;
+}
+
+unsigned TraceManager::get_timestamp(unsigned idx) const {
+	assert(idx < n_records && !runs.empty());
+	// The last run starting at or before <idx>. 
+	vector<pair<unsigned, unsigned> >::const_iterator it = upper_bound(
+			runs.begin(), runs.end(), make_pair(idx, (unsigned)-1));
+	--it;
+	return it->second + (idx - it->first);
+}
+
+bool TraceManager::compare_timestamp(unsigned timestamp, const Checkpoint &cp) {
+	return timestamp < cp.timestamp;
+}
+
+void TraceManager::advance_thread(int tid) const {
+	const ThreadTrace &t = threads[tid];
+	ThreadCursor &c = cursors[tid];
+	while (!(c.valid = c.decoder.next(c.record))) {
+		if (c.block + 1 >= t.blocks.size())
+			return;
+		++c.block;
+		c.decoder = TraceBlockDecoder(t.blocks[c.block]);
+	}
+}
+
+void TraceManager::seek_thread(int tid, unsigned timestamp) const {
+	const ThreadTrace &t = threads[tid];
+	ThreadCursor &c = cursors[tid];
+	c.valid = false;
+	if (t.checkpoints.empty())
+		return;
+	// Resume from the last checkpoint <= <timestamp>. 
+	vector<Checkpoint>::const_iterator it = upper_bound(t.checkpoints.begin(),
+			t.checkpoints.end(), timestamp, compare_timestamp);
+	if (it != t.checkpoints.begin())
+		--it;
+	c.block = it->block;
+	c.decoder = TraceBlockDecoder(t.blocks[c.block]);
+	c.decoder.p = it->p;
+	c.decoder.n_decoded = it->n_decoded;
+	c.decoder.prev_ins_id = it->prev_ins_id;
+	c.decoder.prev_timestamp = it->prev_timestamp;
+	// At most CheckpointInterval records. 
+	do {
+		advance_thread(tid);
+	} while (c.valid && c.record.timestamp < timestamp);
+}
+
+int TraceManager::locate(unsigned idx) const {
+	assert(idx < n_records);
+	if (cur_idx != INVALID_IDX && idx == cur_idx + 1) {
+		// The common case: scanning the trace in order. 
+		pop_heap(heap.begin(), heap.end(), greater<pair<unsigned, int> >());
+		int tid = heap.back().second;
+		advance_thread(tid);
+		if (cursors[tid].valid) {
+			heap.back().first = cursors[tid].record.timestamp;
+			push_heap(heap.begin(), heap.end(), greater<pair<unsigned, int> >());
+		} else {
+			heap.pop_back();
+		}
+		cur_idx = idx;
+	} else if (idx != cur_idx) {
+		unsigned timestamp = get_timestamp(idx);
+		heap.clear();
+		for (size_t tid = 0; tid < threads.size(); ++tid) {
+			seek_thread(tid, timestamp);
+			if (cursors[tid].valid)
+				heap.push_back(make_pair(cursors[tid].record.timestamp, (int)tid));
+		}
+		make_heap(heap.begin(), heap.end(), greater<pair<unsigned, int> >());
+		cur_idx = idx;
+	}
+	assert(!heap.empty());
+	return heap.front().second;
 }
 
-const TraceRecord &TraceManager::get_record(unsigned idx) const {
-	assert(idx < records.size());
-	return records[idx];
+TraceRecord TraceManager::get_record(unsigned idx) const {
+	TraceRecord record = cursors[locate(idx)].record;
+	record.timestamp = idx;
+	return record;
 }
 
-const TraceRecordInfo &TraceManager::get_record_info(unsigned idx) const {
-	assert(idx < record_infos.size());
-	return record_infos[idx];
+TraceRecordInfo TraceManager::get_record_info(unsigned idx) const {
+	IDManager &IDM = getAnalysis<IDManager>();
+	TraceRecordInfo info;
+	info.tid = locate(idx);
+	info.ins = IDM.getInstruction(cursors[info.tid].record.ins_id);
+	assert(info.ins);
+	DenseMap<unsigned, int>::const_iterator it = child_tids.find(idx);
+	info.child_tid = (it == child_tids.end() ? INVALID_TID : it->second);
+	return info;
 }
 
 void TraceManager::print(raw_ostream &O, const Module *M) const {
-	for (size_t i = 0, E = record_infos.size(); i < E; ++i) {
-		const TraceRecordInfo &info = record_infos[i];
-		const TraceRecord &record = records[i];
-		O << "[" << info.tid << "] " << record.ins_id;
-		if (info.child_tid != INVALID_TID)
-			O << " creates Thread " << info.child_tid;
+	for (unsigned i = 0; i < n_records; ++i) {
+		int tid = locate(i);
+		O << "[" << tid << "] " << cursors[tid].record.ins_id;
+		DenseMap<unsigned, int>::const_iterator it = child_tids.find(i);
+		if (it != child_tids.end())
+			O << " creates Thread " << it->second;
 		O << "\n";
 	}
 }
@@ -1,57 +1,308 @@
 /**
  * Author: Jingyue
+ *
+ * Each thread appends its trace records to a thread-local buffer, and
+ * flushes the buffer to the trace file in one write when it is full, when
+ * the thread exits, and when the process exits. The records are stamped
+ * with a global logical clock, so that TraceManager can merge the blocks
+ * of different threads back into a total order. See trace-format.h for
+ * how a block is encoded.
  */
 
 #include <errno.h>
 #include <pthread.h>
 
+#include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
-#include <fstream>
-#include <sstream>
-using namespace std;
 
 #include "slicer/trace.h"
+#include "slicer/trace-format.h"
 using namespace slicer;
 
+// # of records each thread buffers before flushing them.
+static const unsigned BUFFER_SIZE = 65536;
+
+struct TraceBuffer {
+	/*
+	 * Taken by the owner when appending a record, and by whoever flushes
+	 * the buffer. Only contended when the process exits.
+	 */
+	pthread_mutex_t lock;
+	// Set when the process exits. Records appended later are dropped.
+	bool stopped;
+	unsigned n_records;
+	TraceRecord records[BUFFER_SIZE];
+	// Scratch space to encode <records>.
+	char encoded[sizeof(TraceBlockHeader) +
+		BUFFER_SIZE * MAX_ENCODED_RECORD_SIZE];
+	// All buffers are chained so that we can flush them at exit.
+	TraceBuffer *prev, *next;
+};
+
+/*
+ * Protects <trace_fd>, <buffers> and <tracing_stopped>. Only taken when
+ * flushing, never when appending a record or creating a thread.
+ * Always taken before the lock of a buffer.
+ */
 static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool tracing_stopped = false;
 static bool multi_processed = false;
+static int trace_fd = -1;
+// The process that opened <trace_fd>.
+static pid_t trace_pid = -1;
+static TraceBuffer *buffers = NULL;
+// The global logical clock. 64-bit so that it never wraps around.
+static unsigned long trace_clock = 0;
 
-static void __append_to_trace(const TraceRecord &record) {
-	ostringstream oss;
-	oss << "/tmp/fulltrace";
+static pthread_once_t setup_once = PTHREAD_ONCE_INIT;
+// Used only to flush the buffer when a thread exits.
+static pthread_key_t buffer_key;
+static __thread TraceBuffer *local_buffer = NULL;
+
+static void write_all(int fd, const char *p, size_t len) {
+	while (len > 0) {
+		ssize_t written = write(fd, p, len);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		p += written;
+		len -= written;
+	}
+}
+
+/*
+ * Creates <path> with the file header unless it exists. Processes forked
+ * from the traced program append to the same file, so the header is
+ * written to a private file first and then linked to <path>. Therefore,
+ * nobody can append a block to <path> before its header.
+ */
+static void create_trace_file(const char *path) {
+	char tmp_path[96];
+	snprintf(tmp_path, sizeof tmp_path, "%s.tmp.%d", path, (int)getpid());
+	int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		return;
+	TraceFileHeader header;
+	init_trace_file_header(header);
+	write_all(fd, (const char *)&header, sizeof header);
+	close(fd);
+	// Fails with EEXIST if another process has created <path>.
+	link(tmp_path, path);
+	unlink(tmp_path);
+}
+
+/* Requires holding <trace_mutex>. */
+static void open_trace() {
+	if (trace_fd != -1 && trace_pid == getpid())
+		return;
+	if (trace_fd != -1)
+		close(trace_fd);
+	char path[64];
 	if (multi_processed)
-		oss << "." << getpid();
-	ofstream fout(oss.str().c_str(), ios::binary | ios::app);
-	fout.write((char *)&record, sizeof record);
+		snprintf(path, sizeof path, "/tmp/fulltrace.%d", (int)getpid());
+	else
+		snprintf(path, sizeof path, "/tmp/fulltrace");
+	trace_fd = open(path, O_WRONLY | O_APPEND);
+	if (trace_fd == -1 && errno == ENOENT) {
+		create_trace_file(path);
+		trace_fd = open(path, O_WRONLY | O_APPEND);
+	}
+	trace_pid = getpid();
+}
+
+/* Requires holding <trace_mutex> and the lock of <buffer>. */
+static void __flush_buffer(TraceBuffer *buffer) {
+	if (buffer->n_records == 0)
+		return;
+	open_trace();
+	TraceBlockHeader header;
+	char *end = encode_trace_block(buffer->records, buffer->n_records, header,
+			buffer->encoded + sizeof header);
+	memcpy(buffer->encoded, &header, sizeof header);
+	write_all(trace_fd, buffer->encoded, end - buffer->encoded);
+	buffer->n_records = 0;
+}
+
+static void flush_buffer(TraceBuffer *buffer) {
+	pthread_mutex_lock(&trace_mutex);
+	pthread_mutex_lock(&buffer->lock);
+	__flush_buffer(buffer);
+	pthread_mutex_unlock(&buffer->lock);
+	pthread_mutex_unlock(&trace_mutex);
+}
+
+/*
+ * Flushes and stops the buffers of all threads.
+ * Threads still running at this point wait for their buffers to be
+ * flushed, and the records they generate afterwards are dropped.
+ */
+static void flush_all_buffers() {
+	pthread_mutex_lock(&trace_mutex);
+	tracing_stopped = true;
+	for (TraceBuffer *buffer = buffers; buffer; buffer = buffer->next) {
+		pthread_mutex_lock(&buffer->lock);
+		__flush_buffer(buffer);
+		buffer->stopped = true;
+		pthread_mutex_unlock(&buffer->lock);
+	}
+	pthread_mutex_unlock(&trace_mutex);
 }
 
-static void append_to_trace(const TraceRecord &record) {
+static void destroy_buffer(void *arg) {
+	TraceBuffer *buffer = (TraceBuffer *)arg;
 	pthread_mutex_lock(&trace_mutex);
-	__append_to_trace(record);
+	pthread_mutex_lock(&buffer->lock);
+	__flush_buffer(buffer);
+	pthread_mutex_unlock(&buffer->lock);
+	if (buffer->prev)
+		buffer->prev->next = buffer->next;
+	else
+		buffers = buffer->next;
+	if (buffer->next)
+		buffer->next->prev = buffer->prev;
 	pthread_mutex_unlock(&trace_mutex);
+	local_buffer = NULL;
+	pthread_mutex_destroy(&buffer->lock);
+	free(buffer);
+}
+
+/*
+ * The child of fork only has the forking thread. Buffers of the other
+ * threads are stale copies whose records belong to the parent.
+ */
+static void prepare_fork() {
+	if (local_buffer)
+		flush_buffer(local_buffer);
+}
+
+static void after_fork_in_child() {
+	pthread_mutex_init(&trace_mutex, NULL);
+	buffers = local_buffer;
+	if (local_buffer) {
+		pthread_mutex_init(&local_buffer->lock, NULL);
+		local_buffer->prev = local_buffer->next = NULL;
+		local_buffer->n_records = 0;
+	}
+	/*
+	 * Unless in multi-process mode, the child would stamp records with its
+	 * copy of the clock and append them to the parent's trace, duplicating
+	 * the parent's timestamps. Only the parent is traced then. 
+	 */
+	if (!multi_processed) {
+		tracing_stopped = true;
+		if (local_buffer)
+			local_buffer->stopped = true;
+	}
+}
+
+static void setup_trace() {
+	pthread_key_create(&buffer_key, destroy_buffer);
+	pthread_atfork(prepare_fork, NULL, after_fork_in_child);
+	atexit(flush_all_buffers);
+}
+
+static TraceBuffer *get_local_buffer() {
+	if (local_buffer)
+		return local_buffer;
+	pthread_once(&setup_once, setup_trace);
+	TraceBuffer *buffer = (TraceBuffer *)malloc(sizeof(TraceBuffer));
+	pthread_mutex_init(&buffer->lock, NULL);
+	buffer->n_records = 0;
+	buffer->prev = NULL;
+	pthread_mutex_lock(&trace_mutex);
+	buffer->stopped = tracing_stopped;
+	buffer->next = buffers;
+	if (buffers)
+		buffers->prev = buffer;
+	buffers = buffer;
+	pthread_mutex_unlock(&trace_mutex);
+	pthread_setspecific(buffer_key, buffer);
+	local_buffer = buffer;
+	return buffer;
+}
+
+/*
+ * TraceManager orders the records by 32-bit timestamps. Returns false
+ * instead of wrapping around and silently misordering the records.
+ */
+static bool next_timestamp(unsigned &timestamp) {
+	unsigned long t = __sync_fetch_and_add(&trace_clock, 1);
+	if (t >= (unsigned)-1)
+		return false;
+	timestamp = (unsigned)t;
+	return true;
+}
+
+/*
+ * Stops tracing when the clock runs out. The trace keeps the records
+ * stamped so far, and the traced program keeps running. 
+ */
+static void truncate_trace() {
+	static int reported = 0;
+	if (__sync_bool_compare_and_swap(&reported, 0, 1)) {
+		fprintf(stderr, "[Warning] The trace has more than %u records. "
+				"Truncated it.\n", (unsigned)-1);
+	}
+	flush_all_buffers();
+}
+
+/*
+ * Appends a record to the current thread's buffer.
+ * Returns the position of the record in the buffer, or -1 if the record
+ * is dropped because tracing has stopped.
+ */
+static int append_record(unsigned ins_id) {
+	TraceBuffer *buffer = get_local_buffer();
+	// Only the owner appends, so <n_records> can only become smaller
+	// between this check and taking the lock.
+	if (buffer->n_records == BUFFER_SIZE)
+		flush_buffer(buffer);
+	pthread_mutex_lock(&buffer->lock);
+	if (buffer->stopped) {
+		pthread_mutex_unlock(&buffer->lock);
+		return -1;
+	}
+	unsigned timestamp;
+	if (!next_timestamp(timestamp)) {
+		pthread_mutex_unlock(&buffer->lock);
+		truncate_trace();
+		return -1;
+	}
+	int pos = buffer->n_records++;
+	TraceRecord &record = buffer->records[pos];
+	record.ins_id = ins_id;
+	record.timestamp = timestamp;
+	record.raw_tid = pthread_self();
+	record.raw_child_tid = INVALID_RAW_TID;
+	pthread_mutex_unlock(&buffer->lock);
+	return pos;
 }
 
 extern "C" void init_trace(bool mp) {
 	multi_processed = mp;
 	pthread_mutex_lock(&trace_mutex);
-	// There might be multiple processes. Thus we use fulltrace*. 
+	// There might be multiple processes. Thus we use fulltrace*.
 	system("rm -f /tmp/fulltrace*");
+	if (trace_fd != -1) {
+		close(trace_fd);
+		trace_fd = -1;
+	}
 	pthread_mutex_unlock(&trace_mutex);
 }
 
 /*
  * Injected to the traced program
- * Need restore <errno> at the end. 
+ * Need restore <errno> at the end.
  */
 extern "C" void trace_inst(unsigned ins_id) {
 	int saved_errno = errno;
-	TraceRecord record;
-	record.ins_id = ins_id;
-	record.raw_tid = pthread_self();
-	record.raw_child_tid = INVALID_RAW_TID;
-	append_to_trace(record);
+	append_record(ins_id);
 	errno = saved_errno;
 }
 
@@ -60,18 +311,26 @@ extern "C" void trace_inst(unsigned ins_id) {
 extern "C" int trace_pthread_create(
 		unsigned ins_id, pthread_t *thread, const pthread_attr_t *attr,
 		void *(*start_routine)(void *), void *arg) {
-	pthread_mutex_lock(&trace_mutex);
-
-	TraceRecord record;
-	record.ins_id = ins_id;
-	record.raw_tid = pthread_self();
+	/*
+	 * Append the record and take the timestamp before the child starts, so
+	 * that the record precedes all records of the child in the total order.
+	 * The child thread ID is filled in after pthread_create returns. The slot
+	 * is in the current thread's own buffer, so no lock is held across
+	 * pthread_create and other threads keep tracing and flushing meanwhile.
+	 * Only the exit flush can write the slot in between, and it stops the
+	 * buffer when doing so.
+	 */
+	int pos = append_record(ins_id);
 	int ret = pthread_create(thread, attr, start_routine, arg);
 	int saved_errno = errno;
-	record.raw_child_tid = *thread;
-	__append_to_trace(record);
+	if (ret == 0 && pos != -1) {
+		TraceBuffer *buffer = local_buffer;
+		pthread_mutex_lock(&buffer->lock);
+		if (!buffer->stopped)
+			buffer->records[pos].raw_child_tid = *thread;
+		pthread_mutex_unlock(&buffer->lock);
+	}
 	errno = saved_errno;
-	
-	pthread_mutex_unlock(&trace_mutex);
-	
+
 	return ret;
 }
@@ -0,0 +1,221 @@
+/**
+ * Author: Jingyue
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "llvm/Support/raw_ostream.h"
+using namespace llvm;
+
+#include "slicer/worker-pool.h"
+using namespace slicer;
+
+static bool write_all(int fd, const char *p, size_t len) {
+	while (len > 0) {
+		ssize_t written = write(fd, p, len);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		p += written;
+		len -= written;
+	}
+	return true;
+}
+
+static bool read_all(int fd, char *p, size_t len) {
+	while (len > 0) {
+		ssize_t n_read = read(fd, p, len);
+		if (n_read < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		if (n_read == 0)
+			return false;
+		p += n_read;
+		len -= n_read;
+	}
+	return true;
+}
+
+static double now() {
+	timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + 0.000001 * tv.tv_usec;
+}
+
+namespace {
+	/*
+	 * What run_shards needs to know about a kind of task: how to run a
+	 * shard, and how to send the results of a shard from a worker to the
+	 * parent. 
+	 */
+	struct ShardRunner {
+		virtual ~ShardRunner() {}
+		// Runs the tasks in [s, e), the <w>-th shard. 
+		virtual void run(unsigned w, unsigned s, unsigned e) = 0;
+		// Called by the worker after <run>. Returns false if the write fails. 
+		virtual bool serialize(int fd, unsigned w, unsigned s, unsigned e) = 0;
+		// Called by the parent. Returns false if the worker failed. 
+		virtual bool deserialize(int fd, unsigned w, unsigned s, unsigned e) = 0;
+	};
+}
+
+/*
+ * Splits [0, n) into <n_jobs> contiguous shards and runs each shard in a
+ * forked worker. Runs a shard in the current process if its worker fails
+ * or cannot be started. 
+ */
+static void run_shards(ShardRunner &runner, unsigned n, unsigned n_jobs) {
+	if (n_jobs <= 1) {
+		runner.run(0, 0, n);
+		return;
+	}
+
+	vector<pid_t> pids(n_jobs, -1);
+	vector<int> fds(n_jobs, -1);
+	for (unsigned w = 0; w < n_jobs; ++w) {
+		unsigned s = (unsigned long)n * w / n_jobs;
+		unsigned e = (unsigned long)n * (w + 1) / n_jobs;
+		int pipe_fds[2];
+		if (pipe(pipe_fds) == -1)
+			continue;
+		pid_t pid = fork();
+		if (pid == -1) {
+			close(pipe_fds[0]);
+			close(pipe_fds[1]);
+			continue;
+		}
+		if (pid == 0) {
+			// Worker. Don't run any destructor or atexit handler of the parent.
+			close(pipe_fds[0]);
+			runner.run(w, s, e);
+			bool ok = runner.serialize(pipe_fds[1], w, s, e);
+			close(pipe_fds[1]);
+			_exit(ok ? 0 : 1);
+		}
+		close(pipe_fds[1]);
+		pids[w] = pid;
+		fds[w] = pipe_fds[0];
+	}
+
+	for (unsigned w = 0; w < n_jobs; ++w) {
+		unsigned s = (unsigned long)n * w / n_jobs;
+		unsigned e = (unsigned long)n * (w + 1) / n_jobs;
+		bool ok = false;
+		if (pids[w] != -1) {
+			ok = runner.deserialize(fds[w], w, s, e);
+			close(fds[w]);
+			int status;
+			while (waitpid(pids[w], &status, 0) == -1 && errno == EINTR);
+		}
+		if (!ok) {
+			// The worker failed or was never started. Do its shard here.
+			errs() << "[Warning] Worker " << w << " failed. "
+				"Running its tasks in the main process.\n";
+			runner.run(w, s, e);
+		}
+	}
+}
+
+namespace {
+	struct IntShardRunner: public ShardRunner {
+		IntShardRunner(WorkerTask &t, vector<int> &r, vector<double> &st):
+			task(t), results(r), shard_times(st) {}
+
+		virtual void run(unsigned w, unsigned s, unsigned e) {
+			double start_time = now();
+			task.start(s, e);
+			for (unsigned i = s; i < e; ++i)
+				results[i] = task.run(i);
+			task.finish();
+			shard_times[w] = now() - start_time;
+		}
+
+		virtual bool serialize(int fd, unsigned w, unsigned s, unsigned e) {
+			return write_all(fd, (const char *)&results[s],
+					(e - s) * sizeof(int)) &&
+				write_all(fd, (const char *)&shard_times[w], sizeof(double));
+		}
+
+		virtual bool deserialize(int fd, unsigned w, unsigned s, unsigned e) {
+			return read_all(fd, (char *)&results[s], (e - s) * sizeof(int)) &&
+				read_all(fd, (char *)&shard_times[w], sizeof(double));
+		}
+
+		WorkerTask &task;
+		vector<int> &results;
+		vector<double> &shard_times;
+	};
+
+	// Each result is sent as its length followed by its items. 
+	struct ListShardRunner: public ShardRunner {
+		ListShardRunner(ListWorkerTask &t, vector<vector<unsigned> > &r):
+			task(t), results(r) {}
+
+		virtual void run(unsigned w, unsigned s, unsigned e) {
+			for (unsigned i = s; i < e; ++i) {
+				// May be partially filled by a failed worker. 
+				results[i].clear();
+				task.run(i, results[i]);
+			}
+		}
+
+		virtual bool serialize(int fd, unsigned w, unsigned s, unsigned e) {
+			for (unsigned i = s; i < e; ++i) {
+				size_t len = results[i].size();
+				if (!write_all(fd, (const char *)&len, sizeof len))
+					return false;
+				if (len > 0 && !write_all(fd, (const char *)&results[i][0],
+							len * sizeof(unsigned)))
+					return false;
+			}
+			return true;
+		}
+
+		virtual bool deserialize(int fd, unsigned w, unsigned s, unsigned e) {
+			for (unsigned i = s; i < e; ++i) {
+				size_t len;
+				if (!read_all(fd, (char *)&len, sizeof len))
+					return false;
+				results[i].resize(len);
+				if (len > 0 && !read_all(fd, (char *)&results[i][0],
+							len * sizeof(unsigned)))
+					return false;
+			}
+			return true;
+		}
+
+		ListWorkerTask &task;
+		vector<vector<unsigned> > &results;
+	};
+}
+
+void slicer::run_in_workers(WorkerTask &task, unsigned n, unsigned n_jobs,
+		vector<int> &results, vector<double> *shard_times) {
+	results.assign(n, 0);
+	if (n_jobs > n)
+		n_jobs = n;
+	if (n_jobs == 0)
+		n_jobs = 1;
+	vector<double> times(n_jobs, 0.0);
+	IntShardRunner runner(task, results, times);
+	run_shards(runner, n, n_jobs);
+	if (shard_times)
+		shard_times->swap(times);
+}
+
+void slicer::run_in_workers(ListWorkerTask &task, unsigned n, unsigned n_jobs,
+		vector<vector<unsigned> > &results) {
+	results.assign(n, vector<unsigned>());
+	if (n_jobs > n)
+		n_jobs = n;
+	ListShardRunner runner(task, results);
+	run_shards(runner, n, n_jobs);
+}
@@ -0,0 +1,112 @@
+/**
+ * Author: Jingyue
+ *
+ * Round-trips random records through the block format of the full trace.
+ * Doesn't depend on LLVM, because neither does the format.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "slicer/trace-format.h"
+using namespace slicer;
+
+/*
+ * Not assert, which -DNDEBUG would compile out along with the calls under
+ * test. 
+ */
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static void check(bool cond, const char *what, int line) {
+	if (!cond) {
+		fprintf(stderr, "Failed: %s at line %d\n", what, line);
+		exit(1);
+	}
+}
+
+static unsigned random_unsigned() {
+	return ((unsigned)rand() << 16) ^ (unsigned)rand();
+}
+
+// Records of one thread, with increasing timestamps.
+static void generate_block(unsigned long raw_tid, unsigned n_records,
+		unsigned &timestamp, vector<TraceRecord> &records) {
+	for (unsigned i = 0; i < n_records; ++i) {
+		TraceRecord record;
+		// Cover both small deltas and the extremes of <ins_id>.
+		switch (rand() % 4) {
+			case 0: record.ins_id = 0; break;
+			case 1: record.ins_id = UINT_MAX; break;
+			case 2: record.ins_id = random_unsigned(); break;
+			default:
+				record.ins_id = (records.empty() ? 0 : records.back().ins_id + 1);
+		}
+		timestamp += (rand() % 8 == 0 ? random_unsigned() % 100000 : 1);
+		record.timestamp = timestamp;
+		record.raw_tid = raw_tid;
+		record.raw_child_tid = (rand() % 16 == 0 ?
+				(unsigned long)random_unsigned() << 20 : INVALID_RAW_TID);
+		records.push_back(record);
+	}
+}
+
+static void append_block(const vector<TraceRecord> &records, string &file) {
+	TraceBlockHeader header;
+	vector<char> encoded(records.size() * MAX_ENCODED_RECORD_SIZE + 1);
+	char *end = encode_trace_block(&records[0], records.size(), header,
+			&encoded[0]);
+	CHECK((size_t)(end - &encoded[0]) == header.n_bytes);
+	file.append((const char *)&header, sizeof header);
+	file.append(&encoded[0], end - &encoded[0]);
+}
+
+static bool same_record(const TraceRecord &a, const TraceRecord &b) {
+	return a.ins_id == b.ins_id && a.timestamp == b.timestamp &&
+		a.raw_tid == b.raw_tid && a.raw_child_tid == b.raw_child_tid;
+}
+
+int main(int argc, char *argv[]) {
+	srand(argc > 1 ? atoi(argv[1]) : 0);
+
+	TraceFileHeader file_header;
+	init_trace_file_header(file_header);
+	string file((const char *)&file_header, sizeof file_header);
+	vector<vector<TraceRecord> > written;
+	unsigned timestamp = 0;
+	for (unsigned b = 0; b < 64; ++b) {
+		written.push_back(vector<TraceRecord>());
+		unsigned long raw_tid = 0x7f0000000000UL + rand() % 8;
+		generate_block(raw_tid, 1 + rand() % 1000, timestamp, written.back());
+		append_block(written.back(), file);
+	}
+
+	vector<const char *> blocks;
+	CHECK(index_trace_blocks(file.data(), file.size(), blocks));
+	CHECK(blocks.size() == written.size());
+	for (size_t b = 0; b < blocks.size(); ++b) {
+		TraceBlockDecoder decoder(blocks[b]);
+		TraceRecord record;
+		size_t n = 0;
+		while (decoder.next(record)) {
+			CHECK(n < written[b].size());
+			CHECK(same_record(record, written[b][n]));
+			++n;
+		}
+		CHECK(n == written[b].size());
+	}
+
+	// A truncated file must be rejected instead of being read past its end.
+	blocks.clear();
+	CHECK(!index_trace_blocks(file.data(), file.size() - 1, blocks));
+	blocks.clear();
+	string bad_version = file;
+	bad_version[sizeof TRACE_MAGIC] ^= 1;
+	CHECK(!index_trace_blocks(bad_version.data(), bad_version.size(), blocks));
+
+	fprintf(stderr, "Passed\n");
+	return 0;
+}
@@ -2,9 +2,12 @@
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <sstream>
+#include <algorithm>
 using namespace std;
 
 #include "slicer/trace.h"
+#include "slicer/trace-format.h"
 #include "slicer/landmark-trace-record.h"
 #include "slicer/trace-manager.h"
 using namespace slicer;
@@ -13,15 +16,36 @@ void print_usage() {
 	fprintf(stderr, "Usage: display-trace <full|landmark> < <trace file>\n");
 }
 
+bool compare_by_timestamp(const TraceRecord &a, const TraceRecord &b) {
+	return a.timestamp < b.timestamp;
+}
+
 void display_full_trace() {
-	TraceRecord record;
-	int idx = 0;
-	while (cin.read((char *)&record, sizeof record)) {
-		printf("%d: inst = %u, tid = %lu", idx, record.ins_id, record.raw_tid);
-		if (record.raw_child_tid != INVALID_RAW_TID)
-			printf(", child tid = %lu", record.raw_child_tid);
+	// Records of different threads are flushed in blocks. Sort them by
+	// timestamps before displaying. 
+	ostringstream oss;
+	oss << cin.rdbuf();
+	string trace = oss.str();
+	vector<const char *> blocks;
+	if (!index_trace_blocks(trace.data(), trace.size(), blocks)) {
+		fprintf(stderr, "Error: The full trace is corrupted or of an unknown "
+				"version\n");
+		exit(1);
+	}
+	vector<TraceRecord> records;
+	for (size_t i = 0; i < blocks.size(); ++i) {
+		TraceBlockDecoder decoder(blocks[i]);
+		TraceRecord record;
+		while (decoder.next(record))
+			records.push_back(record);
+	}
+	stable_sort(records.begin(), records.end(), compare_by_timestamp);
+	for (size_t idx = 0; idx < records.size(); ++idx) {
+		const TraceRecord &r = records[idx];
+		printf("%zu: inst = %u, tid = %lu", idx, r.ins_id, r.raw_tid);
+		if (r.raw_child_tid != INVALID_RAW_TID)
+			printf(", child tid = %lu", r.raw_child_tid);
 		printf("\n");
-		++idx;
 	}
 }
 